@@ -0,0 +1,17 @@
+#pragma once
+
+#include <eosiolib/name.hpp>
+
+namespace metpack {
+
+   // mptcrowdsale spreads its buyer rows over this many scopes
+   static constexpr uint32_t buyer_shard_bits = 4;
+   static constexpr uint64_t buyer_shards     = 1ull << buyer_shard_bits;
+
+   // scope of a buyer row, fibonacci hashing so names sharing a prefix still spread
+   constexpr uint64_t buyer_shard( eosio::name buyer )
+   {
+      return ( buyer.value * 0x9E3779B97F4A7C15ull ) >> ( 64 - buyer_shard_bits );
+   }
+
+} /// namespace metpack
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/dispatcher.hpp>
+#include <eosiolib/name.hpp>
+
+#include "instrument.hpp"
+
+#include <cstdint>
+
+// apply entry point shared by the metpack contracts. Own actions go through
+// the plain EOSIO_DISPATCH_HELPER switch on the 64 bit action name, the
+// names are sparse so that is a chain of compares, not a jump table.
+// Notifications are a compile time list of (code, action) pairs checked with
+// constant compares before any action data is read, anything not on the list
+// returns without touching the data.
+namespace metpack {
+
+   // calls handler with the record its argument type decodes itself through
+   // a static read(), so a notification never goes through execute_action
+   template<typename Contract, typename Record>
+   void run_notification( uint64_t receiver, uint64_t code, void (Contract::*handler)( const Record& ) )
+   {
+      Contract obj( eosio::name( receiver ), eosio::name( code ), eosio::datastream<const char*>( nullptr, 0 ) );
+      ( obj.*handler )( Record::read() );
+   }
+
+   // notification of Action sent by the contract Code, handled by the member Handler
+   template<uint64_t Code, uint64_t Action, auto Handler>
+   struct on_notify {
+      static constexpr uint64_t code   = Code;
+      static constexpr uint64_t action = Action;
+
+      static void run( uint64_t receiver, uint64_t from_code )
+      {
+         action_probe probe( Action );
+         run_notification( receiver, from_code, Handler );
+      }
+   };
+
+   template<typename... Notifications>
+   struct notifications {
+      // runs the first entry matching code and action, if any
+      static void dispatch( uint64_t receiver, uint64_t code, uint64_t action )
+      {
+         ( void )( ( code == Notifications::code && action == Notifications::action
+                     && ( Notifications::run( receiver, code ), true ) ) || ... );
+      }
+   };
+
+} /// namespace metpack
+
+// the native build links every contract into one binary and names each
+// entry point after its contract
+#ifndef METPACK_APPLY
+#define METPACK_APPLY apply
+#endif
+
+// NOTIFICATIONS is a metpack::notifications type, give it a name first as
+// the commas of its template arguments would split the macro arguments
+#define METPACK_DISPATCH_NOTIFY( TYPE, MEMBERS, NOTIFICATIONS ) \
+extern "C" { \
+   void METPACK_APPLY( uint64_t receiver, uint64_t code, uint64_t action ) { \
+      if( code == receiver ) { \
+         metpack::action_probe probe( action ); \
+         switch( action ) { \
+            EOSIO_DISPATCH_HELPER( TYPE, MEMBERS ) \
+         } \
+         return; \
+      } \
+      NOTIFICATIONS::dispatch( receiver, code, action ); \
+   } \
+}
+
+// contract that handles no notifications
+#define METPACK_DISPATCH( TYPE, MEMBERS ) \
+   METPACK_DISPATCH_NOTIFY( TYPE, MEMBERS, metpack::notifications<> )
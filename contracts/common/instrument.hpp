@@ -0,0 +1,274 @@
+#pragma once
+
+#include <eosiolib/action.hpp>
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/multi_index.hpp>
+#include <eosiolib/name.hpp>
+#include <eosiolib/print.hpp>
+#include <eosiolib/system.hpp>
+
+#include <utility>
+
+// Opt-in per action counters of table operations and inline sends. Built with
+// -DMETPACK_INSTRUMENT (make instrumented) every action prints one json record
+// of what it did. Without the flag metpack::multi_index is eosio::multi_index,
+// metpack::send is action::send and the probe is empty, so release builds are
+// unchanged. Generate the abi from a release build, abigen does not see tables
+// through the counting wrapper.
+namespace metpack {
+
+#ifdef METPACK_INSTRUMENT
+
+   struct op_counters {
+      uint32_t finds        = 0;
+      uint32_t gets         = 0;
+      uint32_t emplaces     = 0;
+      uint32_t modifies     = 0;
+      uint32_t erases       = 0;
+      uint32_t steps        = 0;
+      uint32_t inline_sends = 0;
+      uint64_t bytes_packed = 0;
+   };
+
+   inline op_counters& counters()
+   {
+      static op_counters c;
+      return c;
+   }
+
+   // table iterator counting every step, each one is a db_next or db_previous on chain
+   template<typename Iterator>
+   struct counting_iterator : Iterator {
+      counting_iterator() = default;
+      counting_iterator( const Iterator& it ) : Iterator( it ) {}
+
+      counting_iterator& operator++()
+      {
+         ++counters().steps;
+         Iterator::operator++();
+         return *this;
+      }
+
+      counting_iterator& operator--()
+      {
+         ++counters().steps;
+         Iterator::operator--();
+         return *this;
+      }
+
+      counting_iterator operator++( int ) { counting_iterator result( *this ); ++( *this ); return result; }
+      counting_iterator operator--( int ) { counting_iterator result( *this ); --( *this ); return result; }
+   };
+
+   // secondary index of a counting multi_index, modify and erase go around the
+   // wrapper to the base table so they are counted here
+   template<typename Index>
+   class counting_index : public Index
+   {
+      using base_iterator = typename Index::const_iterator;
+
+      public:
+         using const_iterator = counting_iterator<base_iterator>;
+
+         explicit counting_index( const Index& idx ) : Index( idx ) {}
+
+         const_iterator begin()const
+         {
+            ++counters().steps;
+            return Index::begin();
+         }
+
+         const_iterator end()const    { return Index::end(); }
+         const_iterator cbegin()const { return begin(); }
+         const_iterator cend()const   { return end(); }
+
+         template<typename Key>
+         const_iterator find( const Key& key )const
+         {
+            ++counters().finds;
+            return Index::find( key );
+         }
+
+         template<typename Key>
+         const_iterator lower_bound( const Key& key )const
+         {
+            ++counters().finds;
+            return Index::lower_bound( key );
+         }
+
+         template<typename Key>
+         const_iterator upper_bound( const Key& key )const
+         {
+            ++counters().finds;
+            return Index::upper_bound( key );
+         }
+
+         template<typename Key>
+         const auto& get( const Key& key, const char* error_msg = "unable to find secondary key" )const
+         {
+            ++counters().gets;
+            return Index::get( key, error_msg );
+         }
+
+         template<typename Lambda>
+         void modify( base_iterator itr, eosio::name payer, Lambda&& updater )
+         {
+            ++counters().modifies;
+            Index::modify( itr, payer, [&]( auto& o ) {
+               updater( o );
+               counters().bytes_packed += eosio::pack_size( o );
+            });
+         }
+
+         const_iterator erase( base_iterator itr )
+         {
+            ++counters().erases;
+            return Index::erase( itr );
+         }
+   };
+
+   template<eosio::name::raw TableName, typename T, typename... Indices>
+   class multi_index : public eosio::multi_index<TableName, T, Indices...>
+   {
+      using base = eosio::multi_index<TableName, T, Indices...>;
+
+      public:
+         using base::base;
+
+         using const_iterator = counting_iterator<typename base::const_iterator>;
+
+         const_iterator begin()const
+         {
+            ++counters().steps;
+            return base::begin();
+         }
+
+         const_iterator end()const    { return base::end(); }
+         const_iterator cbegin()const { return begin(); }
+         const_iterator cend()const   { return end(); }
+
+         const_iterator find( uint64_t primary )const
+         {
+            ++counters().finds;
+            return base::find( primary );
+         }
+
+         const_iterator lower_bound( uint64_t primary )const
+         {
+            ++counters().finds;
+            return base::lower_bound( primary );
+         }
+
+         const_iterator upper_bound( uint64_t primary )const
+         {
+            ++counters().finds;
+            return base::upper_bound( primary );
+         }
+
+         // looks up the last row on chain the first time it is called
+         uint64_t available_primary_key()const
+         {
+            ++counters().finds;
+            return base::available_primary_key();
+         }
+
+         template<eosio::name::raw IndexName>
+         auto get_index()
+         {
+            return counting_index<decltype( base::template get_index<IndexName>() )>( base::template get_index<IndexName>() );
+         }
+
+         template<eosio::name::raw IndexName>
+         auto get_index()const
+         {
+            return counting_index<decltype( base::template get_index<IndexName>() )>( base::template get_index<IndexName>() );
+         }
+
+         const T& get( uint64_t primary, const char* error_msg = "unable to find key" )const
+         {
+            ++counters().gets;
+            return base::get( primary, error_msg );
+         }
+
+         template<typename Lambda>
+         const_iterator emplace( eosio::name payer, Lambda&& constructor )
+         {
+            ++counters().emplaces;
+            return base::emplace( payer, [&]( auto& obj ) {
+               constructor( obj );
+               counters().bytes_packed += eosio::pack_size( obj );
+            });
+         }
+
+         template<typename Lambda>
+         void modify( typename base::const_iterator itr, eosio::name payer, Lambda&& updater )
+         {
+            eosio::check( itr != this->end(), "cannot pass end iterator to modify" );
+            modify( *itr, payer, std::forward<Lambda>( updater ) );
+         }
+
+         template<typename Lambda>
+         void modify( const T& obj, eosio::name payer, Lambda&& updater )
+         {
+            ++counters().modifies;
+            base::modify( obj, payer, [&]( auto& o ) {
+               updater( o );
+               counters().bytes_packed += eosio::pack_size( o );
+            });
+         }
+
+         const_iterator erase( typename base::const_iterator itr )
+         {
+            ++counters().erases;
+            return base::erase( itr );
+         }
+
+         void erase( const T& obj )
+         {
+            ++counters().erases;
+            base::erase( obj );
+         }
+   };
+
+   inline void send( const eosio::action& act )
+   {
+      ++counters().inline_sends;
+      counters().bytes_packed += eosio::pack_size( act );
+      act.send();
+   }
+
+   // prints the counters of the action when the dispatcher returns from it
+   struct action_probe {
+      uint64_t action;
+
+      explicit action_probe( uint64_t act ) : action( act ) { counters() = op_counters(); }
+
+      ~action_probe()
+      {
+         const auto& c = counters();
+         eosio::print( "{\"action\":\"", eosio::name( action ),
+                       "\",\"find\":", c.finds, ",\"get\":", c.gets,
+                       ",\"emplace\":", c.emplaces, ",\"modify\":", c.modifies,
+                       ",\"erase\":", c.erases, ",\"step\":", c.steps, ",\"inline\":", c.inline_sends,
+                       ",\"bytes\":", c.bytes_packed, "}\n" );
+      }
+   };
+
+#else
+
+   template<eosio::name::raw TableName, typename T, typename... Indices>
+   using multi_index = eosio::multi_index<TableName, T, Indices...>;
+
+   inline void send( const eosio::action& act )
+   {
+      act.send();
+   }
+
+   struct action_probe {
+      explicit action_probe( uint64_t ) {}
+   };
+
+#endif
+
+} /// namespace metpack
+
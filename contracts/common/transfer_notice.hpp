@@ -0,0 +1,37 @@
+#pragma once
+
+#include <eosiolib/action.hpp>
+#include <eosiolib/asset.hpp>
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/name.hpp>
+#include <eosiolib/system.hpp>
+
+namespace metpack {
+
+   // from, to and quantity of a token transfer notification. Only the fixed
+   // size head of the action data is copied to the stack, the memo that
+   // follows it is never read or allocated.
+   struct transfer_notice {
+      eosio::name    from;
+      eosio::name    to;
+      eosio::asset   quantity;
+
+      static constexpr uint32_t head_size = sizeof(uint64_t)    // from
+                                          + sizeof(uint64_t)    // to
+                                          + sizeof(int64_t)     // quantity.amount
+                                          + sizeof(uint64_t);   // quantity.symbol
+
+      static transfer_notice read()
+      {
+         eosio::check( action_data_size() >= head_size, "transfer notification too short" );
+         char buffer[head_size];
+         read_action_data( buffer, head_size );
+
+         eosio::datastream<const char*> ds( buffer, head_size );
+         transfer_notice notice;
+         ds >> notice.from >> notice.to >> notice.quantity;
+         return notice;
+      }
+   };
+
+} /// namespace metpack
@@ -1,6 +1,13 @@
 #include <eosiolib/asset.hpp>
+#include <eosiolib/binary_extension.hpp>
 #include <eosiolib/eosio.hpp>
 #include "metpacktoken.hpp"
+#include "../common/dispatch.hpp"
+#include "../common/instrument.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 using namespace eosio;
 
@@ -28,31 +35,84 @@ class [[eosio::contract]] metpackteam : public contract {
             });
         }
 
+        // Vesting template shared by any number of members, cliff and duration
+        // are seconds after start
+        [[eosio::action]]
+        void addschedule( uint64_t id, uint32_t start, uint32_t cliff, uint32_t duration )
+        {
+            require_auth(get_self());
+            eosio_assert( duration > 0, "duration must be positive" );
+            eosio_assert( cliff <= duration, "cliff must not be after the end of the schedule" );
+            schedules schedulelist( get_self(), get_self().value );
+            auto existing = schedulelist.find( id );
+            eosio_assert( existing == schedulelist.end(), "schedule already exists" );
+            schedulelist.emplace( get_self(), [&]( auto& s ) {
+                s.id = id;
+                s.start = start;
+                s.cliff = cliff;
+                s.duration = duration;
+            });
+        }
+
+        // Member released in one go once the lockup of the token has passed
         [[eosio::action]]
         void addmember( name member_name, name contractname, asset member_credit )
         {
             require_auth(_self);
-            eosio_assert( member_credit.symbol.is_valid(), "invalid symbol name" );
             stats statstable( get_self(), get_self().value );
-            auto statsiterator = statstable.find( contractname.value );
-            eosio_assert( statsiterator != statstable.end(), "token not found");
-            // Check if this contract has enough balance to pay out the credit 
-            asset currbalance = token::get_balance( contractname, get_self(), member_credit.symbol.code());
-            eosio_assert( currbalance.amount >= statstable.get(contractname.value).totalCredit + member_credit.amount, "insufficient funds");
+            const auto& token_entry = statstable.get( contractname.value, "token not found" );
+            add_member( statstable, token_entry, member_name, member_credit, lockup_vesting( token_entry, member_credit.symbol ) );
+        }
 
-            // update total owed credit
-            statstable.modify(statsiterator, get_self(), [&]( auto& statrow )
-            {
-                statrow.totalCredit += member_credit.amount;
-            });         
-            team_index teamlist(get_self(), get_self().value);
-            auto teamiterator = teamlist.find(member_name.value);
-            eosio_assert(teamiterator == teamlist.end(), "team member already in table" );            
-            teamlist.emplace(get_self(), [&]( auto& row ) 
-            {   
-                row.accountname = member_name;
-                row.credit = member_credit;
+        // Members released like addmember, funded with a single balance check
+        [[eosio::action]]
+        void addmembers( name contractname, std::vector<std::pair<name, asset>> members )
+        {
+            require_auth(_self);
+            eosio_assert( !members.empty(), "no members given" );
+            stats statstable( get_self(), get_self().value );
+            const auto& token_entry = statstable.get( contractname.value, "token not found" );
+
+            // sorted by name so duplicates are neighbours and existing rows can be merged in one pass
+            std::sort( members.begin(), members.end(), []( const auto& a, const auto& b ) {
+                return a.first < b.first;
             });
+
+            asset batch_credit( 0, token_entry.currency );
+            for( size_t i = 0; i < members.size(); ++i )
+            {
+                eosio_assert( i == 0 || members[i - 1].first != members[i].first, "team member listed twice" );
+                check_credit( token_entry, members[i].second );
+                batch_credit += members[i].second;
+            }
+            reserve_credit( statstable, token_entry, batch_credit );
+
+            team_index teamlist(get_self(), contractname.value);
+            auto existing = teamlist.lower_bound( members.front().first.value );
+            for( const auto& m : members )
+            {
+                while( existing != teamlist.end() && existing->accountname < m.first ) ++existing;
+                eosio_assert( existing == teamlist.end() || existing->accountname != m.first, "team member already in table" );
+                teamlist.emplace(get_self(), [&]( auto& row ) 
+                {   
+                    row.accountname = m.first;
+                    row.credit = m.second;
+                    row.vest.emplace( lockup_vesting( token_entry, m.second.symbol ) );
+                });
+            }
+        }
+
+        // Member released linearly along a schedule template
+        [[eosio::action]]
+        void addvested( name member_name, name contractname, asset member_credit, uint64_t schedule_id )
+        {
+            require_auth(_self);
+            stats statstable( get_self(), get_self().value );
+            const auto& token_entry = statstable.get( contractname.value, "token not found" );
+            schedules schedulelist( get_self(), get_self().value );
+            const auto& sched = schedulelist.get( schedule_id, "schedule not found" );
+            add_member( statstable, token_entry, member_name, member_credit,
+                        vesting{ sched.start, sched.cliff, sched.duration, asset( 0, member_credit.symbol ) } );
         }
 
         [[eosio::action]]
@@ -63,32 +123,73 @@ class [[eosio::contract]] metpackteam : public contract {
 
             stats statstable( get_self(), get_self().value );
             
-            stat token_entry = statstable.get(tokencontract.value, "token not found");
+            const auto& token_entry = statstable.get(tokencontract.value, "token not found");
             eosio_assert( token_entry.currency == currency, "invalid token" );
-            team_index teamlist(get_self(), get_self().value);
-            auto iterator = teamlist.find( owner.value );
-            member team_member = teamlist.get(owner.value, "team member not found");
-            
-            eosio_assert(token_entry.airdropTimestamp + token_entry.lockupPeriodSeconds < now(), "lockup period has not passed, be patient!");
+            team_index teamlist(get_self(), tokencontract.value);
+            const auto& team_member = teamlist.get(owner.value, "team member not found");
 
-            asset to_pay = team_member.credit;
+            asset to_pay = release( statstable, token_entry, teamlist, team_member );
+            eosio_assert( to_pay.amount > 0, "lockup period has not passed, be patient!" );
+            pay_credit( tokencontract, owner, to_pay );
+        }
 
-            // remove team member from table
-            teamlist.erase(iterator);
+        // Withdraw what has been released of every token the member has credit in
+        [[eosio::action]]
+        void withdrawall( name owner )
+        {
+            require_auth( owner );
 
-            // Transfer MPT to member account
-            action withdrawCredit = action( 
-                //permission_level
-                permission_level(get_self(),"active"_n),
-                //code (target contract)
-                tokencontract,
-                //action in target contract
-                "transfer"_n,
-                //data
-                std::make_tuple(get_self(), owner, to_pay, std::string("teamwithdraw"))
-            );
+            stats statstable( get_self(), get_self().value );
+            bool paid = false;
+            for( auto it = statstable.begin(); it != statstable.end(); ++it )
+            {
+                team_index teamlist(get_self(), it->tokencontract.value);
+                auto team_member = teamlist.find( owner.value );
+                if( team_member == teamlist.end() ) continue;
+
+                asset to_pay = release( statstable, *it, teamlist, *team_member );
+                if( to_pay.amount == 0 ) continue;
+                pay_credit( it->tokencontract, owner, to_pay );
+                paid = true;
+            }
+            eosio_assert( paid, "lockup period has not passed, be patient!" );
+        }
+
+        // Move members from before the per token scopes out of the contract
+        // scope, run in the same transaction as the code update. Members of
+        // other tokens stay behind, so each run starts at cursor and prints
+        // where the next one has to start, empty once the scope is done
+        [[eosio::action]]
+        void moveteam( name tokencontract, name cursor, uint32_t max_rows )
+        {
+            require_auth(get_self());
+            stats statstable( get_self(), get_self().value );
+            const auto& token_entry = statstable.get( tokencontract.value, "token not found" );
 
-            withdrawCredit.send();
+            team_index legacy(get_self(), get_self().value);
+            team_index teamlist(get_self(), tokencontract.value);
+            auto it = legacy.lower_bound( cursor.value );
+            uint32_t moved = 0;
+            for( uint32_t i = 0; i < max_rows && it != legacy.end(); ++i )
+            {
+                if( it->credit.symbol != token_entry.currency )
+                {
+                    ++it;
+                    continue;
+                }
+                teamlist.emplace( get_self(), [&]( auto& row )
+                {
+                    row.accountname = it->accountname;
+                    row.credit = it->credit;
+                    row.vest = it->vest;
+                });
+                it = legacy.erase( it );
+                ++moved;
+            }
+
+            print( "{\"moved\":", moved, ",\"cursor\":\"" );
+            if( it != legacy.end() ) print( it->accountname );
+            print( "\"}" );
         }
 
     private:      
@@ -102,15 +203,139 @@ class [[eosio::contract]] metpackteam : public contract {
             uint64_t primary_key()const { return tokencontract.value; }
         };
 
+        // Release schedule of one member, copied from its template so that a
+        // withdraw only touches the member row
+        struct vesting {
+            uint32_t    start;
+            uint32_t    cliff;
+            uint32_t    duration;
+            asset       withdrawn;
+        };
+
+        // Team members are scoped by token contract, so one account can hold
+        // credit in every token the contract manages
         struct [[eosio::table]] member {
             name    accountname;
             asset   credit;                       
+            binary_extension<vesting> vest;
 
             uint64_t primary_key() const { return accountname.value; }
         };
 
-        typedef eosio::multi_index<"stats"_n, stat > stats;
-        typedef eosio::multi_index<"team"_n, member> team_index;
+        struct [[eosio::table]] schedule {
+            uint64_t    id;
+            uint32_t    start;
+            uint32_t    cliff;
+            uint32_t    duration;
+
+            uint64_t primary_key() const { return id; }
+        };
+
+        typedef metpack::multi_index<"stats"_n, stat > stats;
+        typedef metpack::multi_index<"team"_n, member> team_index;
+        typedef metpack::multi_index<"schedules"_n, schedule> schedules;
+
+        // everything is released at once after the lockup period of the token
+        static vesting lockup_vesting( const stat& token_entry, const symbol& sym )
+        {
+            return vesting{ token_entry.airdropTimestamp, token_entry.lockupPeriodSeconds,
+                            token_entry.lockupPeriodSeconds, asset( 0, sym ) };
+        }
+
+        // credit released at time t, nothing until the cliff has passed and then
+        // linear from start, constant time whatever the length of the schedule
+        static int64_t vested( const vesting& vest, int64_t credit, uint32_t t )
+        {
+            uint64_t elapsed = t > vest.start ? t - vest.start : 0;
+            if( elapsed <= vest.cliff ) return 0;
+            if( elapsed >= vest.duration ) return credit;
+            return static_cast<int64_t>( static_cast<uint128_t>( credit ) * elapsed / vest.duration );
+        }
+
+        // Applies what the member may withdraw now to its row and to the owed
+        // total, returns the amount to pay which may be zero
+        asset release( stats& statstable, const stat& token_entry, team_index& teamlist, const member& team_member )
+        {
+            // members added before vesting are released in one go after the lockup
+            vesting vest = team_member.vest.has_value() ? team_member.vest.value()
+                                                        : lockup_vesting( token_entry, team_member.credit.symbol );
+            int64_t released = vested( vest, team_member.credit.amount, now() );
+            asset to_pay( released - vest.withdrawn.amount, team_member.credit.symbol );
+            if( to_pay.amount == 0 ) return to_pay;
+
+            if( released == team_member.credit.amount )
+            {
+                // remove team member from table
+                teamlist.erase( team_member );
+            }
+            else
+            {
+                vest.withdrawn += to_pay;
+                teamlist.modify( team_member, get_self(), [&]( auto& row )
+                {
+                    row.vest.emplace( vest );
+                });
+            }
+
+            // paid out credit is no longer owed
+            statstable.modify( token_entry, get_self(), [&]( auto& statrow )
+            {
+                statrow.totalCredit -= to_pay.amount;
+            });
+            return to_pay;
+        }
+
+        void pay_credit( name tokencontract, name owner, const asset& to_pay )
+        {
+            // Transfer MPT to member account
+            action withdrawCredit = action( 
+                //permission_level
+                permission_level(get_self(),"active"_n),
+                //code (target contract)
+                tokencontract,
+                //action in target contract
+                "transfer"_n,
+                //data
+                std::make_tuple(get_self(), owner, to_pay, std::string("teamwithdraw"))
+            );
+
+            metpack::send( withdrawCredit );
+        }
+
+        static void check_credit( const stat& token_entry, const asset& member_credit )
+        {
+            eosio_assert( member_credit.symbol.is_valid(), "invalid symbol name" );
+            eosio_assert( member_credit.symbol == token_entry.currency, "invalid token" );
+            eosio_assert( member_credit.amount > 0, "credit must be positive" );
+        }
+
+        void reserve_credit( stats& statstable, const stat& token_entry, const asset& credit )
+        {
+            // Check if this contract has enough balance to pay out the credit 
+            asset currbalance = token::get_balance( token_entry.tokencontract, get_self(), credit.symbol.code());
+            eosio_assert( currbalance.amount >= token_entry.totalCredit + credit.amount, "insufficient funds");
+
+            // update total owed credit
+            statstable.modify(token_entry, get_self(), [&]( auto& statrow )
+            {
+                statrow.totalCredit += credit.amount;
+            });         
+        }
+
+        void add_member( stats& statstable, const stat& token_entry, name member_name, asset member_credit, const vesting& vest )
+        {
+            check_credit( token_entry, member_credit );
+            reserve_credit( statstable, token_entry, member_credit );
+            team_index teamlist(get_self(), token_entry.tokencontract.value);
+            auto teamiterator = teamlist.find(member_name.value);
+            eosio_assert(teamiterator == teamlist.end(), "team member already in table" );            
+            teamlist.emplace(get_self(), [&]( auto& row ) 
+            {   
+                row.accountname = member_name;
+                row.credit = member_credit;
+                row.vest.emplace( vest );
+            });
+        }
 };
 
-EOSIO_DISPATCH( metpackteam, (addtoken) (addmember) (withdraw))
+METPACK_DISPATCH( metpackteam, (addtoken) (addschedule) (addmember) (addmembers) (addvested) (withdraw) (withdrawall) (moveteam))
@@ -25,6 +25,30 @@ void token::create( name   issuer,
        s.supply.symbol = maximum_supply.symbol;
        s.max_supply    = maximum_supply;
        s.issuer        = issuer;
+       s.holder_registry.emplace( false );
+       s.counters.emplace( holder_counters{ 0, asset( 0, sym ), asset( 0, sym ), asset( 0, sym ) } );
+    });
+}
+
+//one time seed of the counters for tokens created before they were kept, values taken off chain,
+//holders counts accounts with a non zero balance like the holder registry
+void token::seedcounters( const symbol& sym, uint64_t holders, asset claimed, asset unclaimed, asset circulating )
+{
+    require_auth( _self );
+
+    stats statstable( _self, sym.code().raw() );
+    const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+    eosio_assert( st.supply.symbol == sym, "symbol precision mismatch" );
+    eosio_assert( !st.counters.has_value(), "counters already seeded" );
+    eosio_assert( claimed.symbol == sym && unclaimed.symbol == sym && circulating.symbol == sym, "symbol precision mismatch" );
+    eosio_assert( claimed + unclaimed == st.supply, "claimed and unclaimed must add up to the supply" );
+
+    statstable.modify( st, same_payer, [&]( auto& s ) {
+       //extensions are read in order, the registry flag has to be present before the counters
+       if( !s.holder_registry.has_value() ) {
+          s.holder_registry.emplace( false );
+       }
+       s.counters.emplace( holder_counters{ holders, claimed, unclaimed, circulating } );
     });
 }
 
@@ -41,11 +65,24 @@ void token::update( name issuer,
     const auto& st = *existing;
     eosio_assert( st.supply.symbol == symbol, "symbol precision mismatch" );
 
+    //circulating leaves out the issuer, its balance changes bucket with the role
+    auto outside = [&]( name owner ) {
+      return owner != "mptcrowdsale"_n && owner != get_self();
+    };
+    if( issuer != st.issuer ) {
+      if( outside( st.issuer ) ) {
+        pending_counters.circulating += balance_cursor( _self, st.issuer, symbol ).balance.amount;
+      }
+      if( outside( issuer ) ) {
+        pending_counters.circulating -= balance_cursor( _self, issuer, symbol ).balance.amount;
+      }
+    }
 
     statstable.modify( st, same_payer, [&]( auto& s ) {
       s.max_supply    = s.max_supply;   
       s.issuer        = issuer;
     });
+    flush_counters( statstable, st );
 }
 
 void token::issue( name to, asset quantity, string memo )
@@ -70,13 +107,175 @@ void token::issue( name to, asset quantity, string memo )
        s.supply += quantity;
     });
 
-    add_balance( st.issuer, quantity, st.issuer, true);
+    add_balance( st, st.issuer, quantity, st.issuer, true);
+    flush_counters( statstable, st );
 
     if( to != st.issuer ) {
-      SEND_INLINE_ACTION( *this, transfer, { {st.issuer, "active"_n} },
-                          { st.issuer, to, quantity, memo }
-      );
+      metpack::send( action( permission_level{ st.issuer, "active"_n }, get_self(), "transfer"_n,
+                             std::make_tuple( st.issuer, to, quantity, memo ) ) );
+    }
+}
+
+void token::issuebatch( vector<pair<name, asset>> recipients, string memo )
+{
+    eosio_assert( !recipients.empty(), "no recipients given" );
+    eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
+
+    auto sym = recipients.front().second.symbol;
+    eosio_assert( sym.is_valid(), "invalid symbol name" );
+
+    stats statstable( _self, sym.code().raw() );
+    auto existing = statstable.find( sym.code().raw() );
+    eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
+    const auto& st = *existing;
+
+    require_auth( st.issuer );
+    eosio_assert( sym == st.supply.symbol, "symbol precision mismatch" );
+
+    asset total( 0, sym );
+    vector<pair<name, asset>> transfers;
+    transfers.reserve( recipients.size() );
+    for( const auto& r : recipients ) {
+       eosio_assert( r.second.is_valid(), "invalid quantity" );
+       eosio_assert( r.second.amount > 0, "must issue positive quantity" );
+       eosio_assert( r.second.symbol == sym, "symbol precision mismatch" );
+       total += r.second;
+       if( r.first != st.issuer ) {
+          transfers.push_back( r );
+       }
+    }
+    eosio_assert( total.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
+
+    statstable.modify( st, same_payer, [&]( auto& s ) {
+       s.supply += total;
+    });
+
+    add_balance( st, st.issuer, total, st.issuer, true );
+    flush_counters( statstable, st );
+
+    //hand everything not kept by the issuer out in a single inline action
+    if( !transfers.empty() ) {
+      metpack::send( action( permission_level{ st.issuer, "active"_n }, get_self(), "transferbatch"_n,
+                             std::make_tuple( st.issuer, transfers, memo ) ) );
+    }
+}
+
+//loads airdrop recipients for drain, the issuer pays for the queue rows. the
+//total is issued into the drop escrow right away, so a queue that does not fit
+//under the max supply is refused here instead of failing drain half way
+void token::queuedrop( vector<pair<name, asset>> recipients )
+{
+    eosio_assert( !recipients.empty(), "no recipients given" );
+
+    auto sym = recipients.front().second.symbol;
+    eosio_assert( sym.is_valid(), "invalid symbol name" );
+
+    stats statstable( _self, sym.code().raw() );
+    auto existing = statstable.find( sym.code().raw() );
+    eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
+    const auto& st = *existing;
+
+    require_auth( st.issuer );
+    eosio_assert( sym == st.supply.symbol, "symbol precision mismatch" );
+
+    dropqueue queue( _self, sym.code().raw() );
+    auto id = queue.available_primary_key();
+    asset total( 0, sym );
+    for( const auto& r : recipients ) {
+       eosio_assert( r.first != st.issuer, "cannot airdrop to issuer" );
+       eosio_assert( is_account( r.first ), "to account does not exist");
+       eosio_assert( r.second.is_valid(), "invalid quantity" );
+       eosio_assert( r.second.amount > 0, "must issue positive quantity" );
+       eosio_assert( r.second.symbol == sym, "symbol precision mismatch" );
+       eosio_assert( r.second.amount <= st.max_supply.amount - st.supply.amount - total.amount, "quantity exceeds available supply");
+       total += r.second;
+       queue.emplace( st.issuer, [&]( auto& q ) {
+          q.id       = id++;
+          q.to       = r.first;
+          q.quantity = r.second;
+          q.reserved.emplace( true );
+       });
     }
+
+    statstable.modify( st, same_payer, [&]( auto& s ) {
+       s.supply += total;
+    });
+    fund_escrow( st, total.amount );
+    flush_counters( statstable, st );
+}
+
+//issues the next max_rows queued airdrops in id order as unclaimed balances
+void token::drain( const symbol& sym, uint32_t max_rows )
+{
+    eosio_assert( sym.is_valid(), "invalid symbol name" );
+    eosio_assert( max_rows > 0, "max_rows must be positive" );
+
+    stats statstable( _self, sym.code().raw() );
+    auto existing = statstable.find( sym.code().raw() );
+    eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
+    const auto& st = *existing;
+
+    require_auth( st.issuer );
+
+    dropqueue queue( _self, sym.code().raw() );
+    auto it = queue.begin();
+    eosio_assert( it != queue.end(), "airdrop queue is empty" );
+
+    require_recipient( st.issuer );
+
+    asset total( 0, st.supply.symbol );
+    asset unreserved( 0, st.supply.symbol );
+    for( uint32_t i = 0; i < max_rows && it != queue.end(); ++i ) {
+       //same as a transfer out of the drop escrow, the issuer pays and the row stays unclaimed,
+       //recipients are notified of the drain like transferbatch notifies them
+       require_recipient( it->to );
+       add_balance( st, it->to, it->quantity, st.issuer, false );
+       total += it->quantity;
+       //rows queued before queuedrop reserved the supply are issued here
+       if( !it->reserved.value_or() ) unreserved += it->quantity;
+       it = queue.erase( it );
+    }
+    fund_escrow( st, unreserved.amount - total.amount );
+
+    if( unreserved.amount > 0 ) {
+       eosio_assert( unreserved.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply");
+       statstable.modify( st, same_payer, [&]( auto& s ) {
+          s.supply += unreserved;
+       });
+    }
+    flush_counters( statstable, st );
+
+    print( "{\"issued\":\"" );
+    total.print();
+    print( "\",\"more\":", it != queue.end() ? "true" : "false", "}" );
+}
+
+//takes queued airdrops out before drain reaches them, so one bad row never holds up
+//the rows behind it. what they reserved leaves the escrow and the supply again
+void token::unqueue( const symbol& sym, vector<uint64_t> ids )
+{
+    eosio_assert( sym.is_valid(), "invalid symbol name" );
+    eosio_assert( !ids.empty(), "no ids given" );
+
+    stats statstable( _self, sym.code().raw() );
+    const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+    require_auth( st.issuer );
+
+    dropqueue queue( _self, sym.code().raw() );
+    asset reserved( 0, st.supply.symbol );
+    for( auto id : ids ) {
+       const auto& q = queue.get( id, "queued airdrop does not exist" );
+       if( q.reserved.value_or() ) reserved += q.quantity;
+       queue.erase( q );
+    }
+
+    if( reserved.amount > 0 ) {
+       statstable.modify( st, same_payer, [&]( auto& s ) {
+          s.supply -= reserved;
+       });
+       fund_escrow( st, -reserved.amount );
+    }
+    flush_counters( statstable, st );
 }
 
 void token::retire( asset quantity, string memo )
@@ -100,7 +299,8 @@ void token::retire( asset quantity, string memo )
        s.supply -= quantity;
     });
 
-    sub_balance( st.issuer, quantity );
+    sub_balance( st, st.issuer, quantity );
+    flush_counters( statstable, st );
 }
 
 void token::transfer( name    from,
@@ -123,48 +323,168 @@ void token::transfer( name    from,
     eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
     eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
 
+    do_transfer( statstable, st, from, to, quantity, from, true );
+}
+
+//sets what spender may move out of the owner balance, zero removes the allowance
+void token::approve( name owner, name spender, asset quantity )
+{
+    require_auth( owner );
+    eosio_assert( owner != spender, "cannot approve self" );
+    eosio_assert( is_account( spender ), "spender account does not exist");
+    auto sym = quantity.symbol.code();
+    stats statstable( _self, sym.raw() );
+    const auto& st = statstable.get( sym.raw(), "symbol does not exist" );
+
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount >= 0, "must approve non-negative quantity" );
+    eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+
+    allowances allowancetable( _self, owner.value );
+    auto byspender = allowancetable.get_index<"byspender"_n>();
+    auto it = byspender.find( allowance_key( spender, sym ) );
+    if( it == byspender.end() ) {
+       if( quantity.amount == 0 ) return;
+       auto id = allowancetable.available_primary_key();
+       allowancetable.emplace( owner, [&]( auto& a ) {
+          a.id       = id;
+          a.spender  = spender;
+          a.quantity = quantity;
+       });
+    } else if( quantity.amount == 0 ) {
+       byspender.erase( it );
+    } else {
+       byspender.modify( it, same_payer, [&]( auto& a ) {
+          a.quantity = quantity;
+       });
+    }
+}
+
+//transfer out of the from balance on its allowance, the spender pays for any new or claimed row
+void token::transferfrom( name    spender,
+                          name    from,
+                          name    to,
+                          asset   quantity,
+                          string  memo )
+{
+    eosio_assert( from != to, "cannot transfer to self" );
+    require_auth( spender );
+    eosio_assert( is_account( to ), "to account does not exist");
+    //the crowdsale only buys tokens back from a plain transfer
+    eosio_assert( to != "mptcrowdsale"_n || from == get_self(), "transfer to the crowdsale with transfer" );
+    auto sym = quantity.symbol.code();
+    stats statstable( _self, sym.raw() );
+    const auto& st = statstable.get( sym.raw() );
+
+    require_recipient( from );
+    require_recipient( to );
+
+    eosio_assert( quantity.is_valid(), "invalid quantity" );
+    eosio_assert( quantity.amount > 0, "must transfer positive quantity" );
+    eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+    eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
+
+    allowances allowancetable( _self, from.value );
+    auto byspender = allowancetable.get_index<"byspender"_n>();
+    auto it = byspender.find( allowance_key( spender, sym ) );
+    eosio_assert( it != byspender.end(), "no allowance found" );
+    eosio_assert( it->quantity.amount >= quantity.amount, "transfer exceeds allowance" );
+    if( it->quantity.amount == quantity.amount ) {
+       byspender.erase( it );
+    } else {
+       byspender.modify( it, same_payer, [&]( auto& a ) {
+          a.quantity -= quantity;
+       });
+    }
+
+    //the spender pays for the rows it creates or claims, the row of from stays billed as it is
+    do_transfer( statstable, st, from, to, quantity, spender, false );
+}
+
+//balance side of transfer and transferfrom, each row is looked up once and written back once.
+//rebill moves the ram of the from row to ram_payer like a modify by the owner does
+void token::do_transfer( stats& statstable, const currency_stats& st, name from, name to, asset quantity, name ram_payer, bool rebill )
+{
+    balance_cursor from_row( _self, from, quantity.symbol );
+
     // don't check transfers from crowdsale contract
-    if( from != "mptcrowdsale"_n || from != get_self()) 
+    if( from != "mptcrowdsale"_n && from != get_self() )
     {
-      checktransfer( from, quantity );
+      checktransfer( from, quantity, from_row.balance );
+    }
+    //both rows are claimed in the same write, dont auto claim when issuer
+    from_row.debit( quantity, ram_payer, rebill );
+    balance_cursor to_row( _self, to, quantity.symbol );
+    to_row.credit( quantity, ram_payer, from != st.issuer );
+    commit_balance( st, from_row );
+    commit_balance( st, to_row );
+    flush_counters( statstable, st );
+}
+
+void token::transferbatch( name    from,
+                           vector<pair<name, asset>> transfers,
+                           string  memo )
+{
+    eosio_assert( !transfers.empty(), "no transfers given" );
+    require_auth( from );
+    auto sym = transfers.front().second.symbol;
+    stats statstable( _self, sym.code().raw() );
+    const auto& st = statstable.get( sym.code().raw() );
+
+    eosio_assert( sym == st.supply.symbol, "symbol precision mismatch" );
+    eosio_assert( memo.size() <= 256, "memo has more than 256 bytes" );
+
+    require_recipient( from );
+
+    asset total( 0, sym );
+    for( const auto& t : transfers ) {
+       eosio_assert( from != t.first, "cannot transfer to self" );
+       eosio_assert( is_account( t.first ), "to account does not exist");
+       //the crowdsale only buys tokens back from a plain transfer
+       eosio_assert( t.first != "mptcrowdsale"_n || from == get_self(), "transfer to the crowdsale with transfer" );
+       eosio_assert( t.second.is_valid(), "invalid quantity" );
+       eosio_assert( t.second.amount > 0, "must transfer positive quantity" );
+       eosio_assert( t.second.symbol == sym, "symbol precision mismatch" );
+       require_recipient( t.first );
+       total += t.second;
     }
-    do_claim( from, quantity.symbol, from );
-    sub_balance( from, quantity );
-    add_balance( to, quantity, from, from != st.issuer );
 
-    //account needs to exist first, dont auto claim when issuer
-    if(from != st.issuer) {
-      do_claim( to, quantity.symbol, from );
+    balance_cursor from_row( _self, from, sym );
+
+    // don't check transfers from crowdsale contract, one check covers the whole batch
+    if( from != "mptcrowdsale"_n && from != get_self() )
+    {
+      checktransfer( from, total, from_row.balance );
+    }
+    //both balance updates claim the touched row in the same write, dont auto claim when issuer
+    from_row.debit( total, from, true );
+    commit_balance( st, from_row );
+    for( const auto& t : transfers ) {
+       add_balance( st, t.first, t.second, from, from != st.issuer );
     }
+    flush_counters( statstable, st );
 }
 
 void token::claim( name owner, const symbol& sym ) {
-  do_claim(owner,sym,owner);
-}
-
-void token::do_claim( name owner, const symbol& sym, name payer ) {
+  require_auth( owner );
   eosio_assert( sym.is_valid(), "invalid symbol name" );
-  auto sym_code_raw = sym.code().raw();
 
-  require_auth( payer );
-  accounts owner_acnts( _self, owner.value );
+  stats statstable( _self, sym.code().raw() );
+  const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+  eosio_assert( st.supply.symbol == sym, "symbol precision mismatch" );
 
-  const auto& existing = owner_acnts.get( sym_code_raw, "no balance object found" );
-  if( !existing.claimed ) {
-    //save the balance
-    auto value = existing.balance;
-    //erase the table freeing ram to the issuer
-    owner_acnts.erase( existing );
-    //create a new index
-    auto replace = owner_acnts.find( sym_code_raw );
-    //confirm there are definitely no balance now
-    eosio_assert(replace == owner_acnts.end(), "there must be no balance object" );
-    //add the new claimed balance paid by owner
-    owner_acnts.emplace( payer, [&]( auto& a ){
-      a.balance = value;
-      a.claimed = true;
-    });
-  }
+  do_claim(st,owner,owner);
+  flush_counters( statstable, st );
+}
+
+//callers are responsible for require_auth( payer )
+void token::do_claim( const currency_stats& st, name owner, name payer ) {
+  balance_cursor owned( _self, owner, st.supply.symbol );
+  eosio_assert( owned.found(), "no balance object found" );
+
+  //a modify with a new payer moves the ram from the issuer to the payer in one db operation
+  owned.claim_by( payer );
+  commit_balance( st, owned );
 }
 
 void token::recover( name owner, const symbol& sym ) {
@@ -179,47 +499,414 @@ void token::recover( name owner, const symbol& sym ) {
   require_auth( st.issuer );
 
   //fail gracefully so we dont have to take another snapshot
-  accounts owner_acnts( _self, owner.value );
-  auto owned = owner_acnts.find( sym_name.code().raw() );
-  if( owned != owner_acnts.end() ) {
-    if( !owned->claimed ) {
-      sub_balance( owner, owned->balance );
-      add_balance( st.issuer, owned->balance, st.issuer, true );
+  auto recovered = take_unclaimed( st, owner );
+  if( recovered.amount > 0 ) {
+    add_balance( st, st.issuer, recovered, st.issuer, true );
+  }
+  flush_counters( statstable, st );
+}
+
+void token::recoverbatch( const symbol& sym, vector<name> owners ) {
+  eosio_assert( sym.is_valid(), "invalid symbol name" );
+
+  stats statstable( _self, sym.code().raw() );
+  auto existing = statstable.find( sym.code().raw() );
+  eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
+  const auto& st = *existing;
+
+  require_auth( st.issuer );
+
+  //fail gracefully per owner and credit the issuer once for the whole batch
+  asset recovered( 0, st.supply.symbol );
+  for( const auto& owner : owners ) {
+    recovered += take_unclaimed( st, owner );
+  }
+  if( recovered.amount > 0 ) {
+    add_balance( st, st.issuer, recovered, st.issuer, true );
+  }
+  flush_counters( statstable, st );
+}
+
+//walks the holder registry from cursor and prints the cursor to continue from
+void token::recoversweep( const symbol& sym, name cursor, uint32_t max_rows ) {
+  eosio_assert( sym.is_valid(), "invalid symbol name" );
+  eosio_assert( max_rows > 0, "max_rows must be positive" );
+
+  stats statstable( _self, sym.code().raw() );
+  auto existing = statstable.find( sym.code().raw() );
+  eosio_assert( existing != statstable.end(), "token with symbol does not exist, create token before issue" );
+  const auto& st = *existing;
+
+  require_auth( st.issuer );
+  eosio_assert( st.holder_registry.value_or(), "holder registry is not enabled" );
+
+  holders registry( _self, sym.code().raw() );
+  auto it = registry.lower_bound( cursor.value );
+  asset recovered( 0, st.supply.symbol );
+  for( uint32_t i = 0; i < max_rows && it != registry.end(); ++i ) {
+    //step past the row first, take_unclaimed erases it from the registry
+    auto owner   = it->owner;
+    auto claimed = it->claimed;
+    ++it;
+    if( !claimed ) {
+      recovered += take_unclaimed( st, owner );
     }
   }
+  if( recovered.amount > 0 ) {
+    add_balance( st, st.issuer, recovered, st.issuer, true );
+  }
+  flush_counters( statstable, st );
+
+  print( "{\"recovered\":\"" );
+  recovered.print();
+  print( "\",\"more\":\"" );
+  if( it != registry.end() ) print( it->owner );
+  print( "\"}" );
+}
+
+//airdrop without a row per recipient: the issuer commits the merkle root of the
+//(index, owner, quantity) leaves and its balance is debited by the total, every
+//recipient then claims its own leaf and pays for its own row. the escrow is no
+//account row, it is total - claimed of the drop, so no transfer can move it
+//
+//drop ids are never reused, a closed drop stays as a tombstone because the
+//claimed flags in dropbits are keyed by its id
+void token::commitdrop( uint64_t drop_id, checksum256 root, asset total, uint64_t leaves ) {
+  auto sym = total.symbol;
+  eosio_assert( sym.is_valid(), "invalid symbol name" );
+  eosio_assert( drop_id < ( 1ull << 24 ), "drop id must be below 2^24" );
+  eosio_assert( leaves > 0 && leaves <= ( 1ull << 46 ), "leaves must be between 1 and 2^46" );
+
+  stats statstable( _self, sym.code().raw() );
+  const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+  require_auth( st.issuer );
+  eosio_assert( total.is_valid(), "invalid quantity" );
+  eosio_assert( total.amount > 0, "must drop positive quantity" );
+  eosio_assert( total.symbol == st.supply.symbol, "symbol precision mismatch" );
+
+  drops droptable( _self, sym.code().raw() );
+  eosio_assert( droptable.find( drop_id ) == droptable.end(), "drop id already used" );
+  droptable.emplace( st.issuer, [&]( auto& d ) {
+    d.id      = drop_id;
+    d.root    = root;
+    d.leaves  = leaves;
+    d.total   = total;
+    d.claimed = asset( 0, sym );
+  });
+
+  sub_balance( st, st.issuer, total );
+  fund_escrow( st, total.amount );
+  flush_counters( statstable, st );
 }
 
-void token::sub_balance( name owner, asset value ) {
-   accounts from_acnts( _self, owner.value );
+void token::claimdrop( name owner, uint64_t drop_id, asset quantity, uint64_t index, vector<checksum256> proof ) {
+  require_auth( owner );
+  auto sym = quantity.symbol;
+  eosio_assert( sym.is_valid(), "invalid symbol name" );
+
+  stats statstable( _self, sym.code().raw() );
+  const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+  eosio_assert( quantity.is_valid(), "invalid quantity" );
+  eosio_assert( quantity.amount > 0, "must claim positive quantity" );
+  eosio_assert( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
+
+  drops droptable( _self, sym.code().raw() );
+  const auto& drop = droptable.get( drop_id, "drop does not exist" );
+  eosio_assert( drop.claimed < drop.total, "drop is closed or fully claimed" );
+  eosio_assert( index < drop.leaves, "leaf index out of range" );
+
+  //walk from the leaf up, the bits of the index tell on which side the sibling is
+  auto packed = pack( std::make_tuple( index, owner, quantity ) );
+  checksum256 node = sha256( packed.data(), packed.size() );
+  uint64_t position = index;
+  for( const auto& sibling : proof ) {
+    auto left  = ( position & 1 ) ? sibling.extract_as_byte_array() : node.extract_as_byte_array();
+    auto right = ( position & 1 ) ? node.extract_as_byte_array() : sibling.extract_as_byte_array();
+    char buffer[64];
+    std::copy( left.begin(), left.end(), buffer );
+    std::copy( right.begin(), right.end(), buffer + 32 );
+    node = sha256( buffer, sizeof(buffer) );
+    position >>= 1;
+  }
+  eosio_assert( node == drop.root, "invalid merkle proof" );
+
+  dropbits bitmap( _self, sym.code().raw() );
+  uint64_t key  = ( drop_id << 40 ) | ( index >> 6 );
+  uint64_t mask = 1ull << ( index & 63 );
+  auto word = bitmap.find( key );
+  if( word == bitmap.end() ) {
+    bitmap.emplace( owner, [&]( auto& w ) {
+      w.key  = key;
+      w.bits = mask;
+    });
+  } else {
+    eosio_assert( !( word->bits & mask ), "drop already claimed" );
+    bitmap.modify( word, same_payer, [&]( auto& w ) {
+      w.bits |= mask;
+    });
+  }
+
+  eosio_assert( drop.claimed + quantity <= drop.total, "drop total exceeded" );
+  droptable.modify( drop, same_payer, [&]( auto& d ) {
+    d.claimed += quantity;
+  });
 
-   const auto& from = from_acnts.get( value.symbol.code().raw(), "no balance object found" );
-   eosio_assert( from.balance.amount >= value.amount, "overdrawn balance" );
+  fund_escrow( st, -quantity.amount );
+  add_balance( st, owner, quantity, owner, true );
+  flush_counters( statstable, st );
+}
 
-   if( from.balance.amount == value.amount ) {
-      from_acnts.erase( from );
+//ends a drop and hands what nobody claimed back to the issuer, the row stays with its
+//total cut down to what was claimed and the claimed flags stay with their payers
+void token::closedrop( const symbol& sym, uint64_t drop_id ) {
+  eosio_assert( sym.is_valid(), "invalid symbol name" );
+
+  stats statstable( _self, sym.code().raw() );
+  const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+  require_auth( st.issuer );
+
+  drops droptable( _self, sym.code().raw() );
+  const auto& drop = droptable.get( drop_id, "drop does not exist" );
+  auto remaining = drop.total - drop.claimed;
+  eosio_assert( remaining.amount > 0, "drop is closed or fully claimed" );
+  droptable.modify( drop, same_payer, [&]( auto& d ) {
+    d.total = d.claimed;
+  });
+
+  fund_escrow( st, -remaining.amount );
+  add_balance( st, st.issuer, remaining, st.issuer, true );
+  flush_counters( statstable, st );
+}
+
+//drop escrow is airdropped supply nobody has claimed yet, it is counted as unclaimed
+//under the contract account so the counters still add up to the supply
+void token::fund_escrow( const currency_stats& st, int64_t delta ) {
+  count_balance( st, _self, delta, false );
+}
+
+//erases an unclaimed airdrop row, freeing the issuer ram, and returns its balance
+asset token::take_unclaimed( const currency_stats& st, name owner ) {
+  accounts owner_acnts( _self, owner.value );
+  auto owned = owner_acnts.find( st.supply.symbol.code().raw() );
+  if( owned == owner_acnts.end() || owned->claimed || owner == st.issuer ) {
+    return asset( 0, st.supply.symbol );
+  }
+
+  auto value = owned->balance;
+  owner_acnts.erase( owned );
+  count_balance( st, owner, -value.amount, false );
+  //rows made by open are unclaimed too but never counted as a holder
+  pending_counters.holders -= value.amount > 0;
+  sync_holder( st, owner, asset( 0, value.symbol ), false );
+  return value;
+}
+
+token::balance_cursor::balance_cursor( name self, name owner, const symbol& sym )
+:acnts( self, owner.value ), row( acnts.find( sym.code().raw() ) ), owner( owner ), balance( 0, sym )
+{
+   if( found() ) {
+      balance = row->balance;
+      claimed = row->claimed;
+   }
+}
+
+//a debit also claims the row, an airdropped row moves its ram to ram_payer and
+//so does any row when rebill is set, as the owner modifying its own row would
+void token::balance_cursor::debit( const asset& value, name ram_payer, bool rebill ) {
+   eosio_assert( found(), "no balance object found" );
+   eosio_assert( balance.amount >= value.amount, "overdrawn balance" );
+   if( !claimed || rebill ) {
+      claimed = true;
+      payer   = ram_payer;
+   }
+   balance   -= value;
+   drop_empty = true;
+}
+
+void token::balance_cursor::credit( const asset& value, name ram_payer, bool claim ) {
+   if( !found() && payer == same_payer ) {
+      //a new row is paid by whoever credits it first
+      payer   = ram_payer;
+      claimed = claim;
+   } else if( claim && !claimed ) {
+      //claim an airdropped row in the same write, moving its ram to ram_payer
+      payer   = ram_payer;
+      claimed = true;
+   }
+   balance += value;
+}
+
+void token::balance_cursor::claim_by( name new_payer ) {
+   if( claimed ) return;
+   claimed = true;
+   payer   = new_payer;
+}
+
+//writes the cursor back with one emplace, modify or erase, untouched rows are not written.
+//a holder is an account with a non zero balance, the same rows the registry lists
+void token::commit_balance( const currency_stats& st, balance_cursor& c )
+{
+   int64_t was_held = 0;
+   if( c.found() ) {
+      if( c.payer == same_payer && c.balance == c.row->balance && c.claimed == c.row->claimed ) return;
+      was_held = c.row->balance.amount > 0;
+
+      //the whole row leaves its bucket, what remains comes back in the one it ends up in
+      count_balance( st, c.owner, -c.row->balance.amount, c.row->claimed );
+      if( c.drop_empty && c.balance.amount == 0 ) {
+         c.acnts.erase( c.row );
+         c.row = c.acnts.end();
+         c.payer = same_payer;
+         c.drop_empty = false;
+         pending_counters.holders -= was_held;
+         sync_holder( st, c.owner, c.balance, true );
+         return;
+      }
+      c.acnts.modify( c.row, c.payer, [&]( auto& a ) {
+         a.balance = c.balance;
+         a.claimed = c.claimed;
+      });
    } else {
-      from_acnts.modify( from, owner, [&]( auto& a ) {
-          a.balance -= value;
+      if( c.payer == same_payer ) return;
+      c.row = c.acnts.emplace( c.payer, [&]( auto& a ) {
+         a.balance = c.balance;
+         a.claimed = c.claimed;
       });
    }
+   pending_counters.holders += int64_t( c.balance.amount > 0 ) - was_held;
+   c.payer = same_payer;
+   c.drop_empty = false;
+   count_balance( st, c.owner, c.balance.amount, c.claimed );
+   sync_holder( st, c.owner, c.balance, c.claimed );
 }
 
-void token::add_balance( name owner, asset value, name ram_payer, bool claimed )
+void token::sub_balance( const currency_stats& st, name owner, asset value ) {
+   balance_cursor from( _self, owner, value.symbol );
+   from.debit( value, owner, true );
+   commit_balance( st, from );
+}
+
+void token::add_balance( const currency_stats& st, name owner, asset value, name ram_payer, bool claimed )
 {
-   accounts to_acnts( _self, owner.value );
-   auto to = to_acnts.find( value.symbol.code().raw() );
-   if( to == to_acnts.end() ) {
-      to_acnts.emplace( ram_payer, [&]( auto& a ){
-        a.balance = value;
-        a.claimed = claimed;
+   balance_cursor to( _self, owner, value.symbol );
+   to.credit( value, ram_payer, claimed );
+   commit_balance( st, to );
+}
+
+void token::count_balance( const currency_stats& st, name owner, int64_t delta, bool claimed )
+{
+   if( claimed ) {
+      pending_counters.claimed += delta;
+   } else {
+      pending_counters.unclaimed += delta;
+   }
+   //merkle drop escrow is counted under the contract account
+   if( owner != st.issuer && owner != "mptcrowdsale"_n && owner != get_self() ) {
+      pending_counters.circulating += delta;
+   }
+}
+
+//writes the counter changes of the action to the stat row in one modify
+void token::flush_counters( stats& statstable, const currency_stats& st )
+{
+   auto delta = pending_counters;
+   pending_counters = counter_delta();
+
+   //counters of tokens created before they were kept only start once seeded
+   if( !st.counters.has_value() ) return;
+   if( delta.holders == 0 && delta.claimed == 0 && delta.unclaimed == 0 && delta.circulating == 0 ) return;
+
+   statstable.modify( st, same_payer, [&]( auto& s ) {
+      auto& c = s.counters.value();
+      c.holders            += delta.holders;
+      c.claimed.amount     += delta.claimed;
+      c.unclaimed.amount   += delta.unclaimed;
+      c.circulating.amount += delta.circulating;
+      //every balance is either claimed or unclaimed, so together they are the supply
+      eosio_assert( c.claimed + c.unclaimed == s.supply, "holder counters out of balance with supply" );
+   });
+}
+
+//keeps the holder registry in step with an account row, zero balances are not listed
+void token::sync_holder( const currency_stats& st, name owner, const asset& balance, bool claimed )
+{
+   if( !st.holder_registry.value_or() ) return;
+
+   holders registry( _self, balance.symbol.code().raw() );
+   auto it = registry.find( owner.value );
+   if( balance.amount == 0 ) {
+      if( it != registry.end() ) {
+         registry.erase( it );
+      }
+   } else if( it == registry.end() ) {
+      registry.emplace( _self, [&]( auto& h ){
+        h.owner   = owner;
+        h.balance = balance;
+        h.claimed = claimed;
       });
    } else {
-      to_acnts.modify( to, same_payer, [&]( auto& a ) {
-        a.balance += value;
+      registry.modify( it, same_payer, [&]( auto& h ) {
+        h.balance = balance;
+        h.claimed = claimed;
       });
    }
 }
 
+void token::setregistry( const symbol& sym, bool enabled )
+{
+   require_auth( _self );
+
+   stats statstable( _self, sym.code().raw() );
+   const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+   eosio_assert( st.supply.symbol == sym, "symbol precision mismatch" );
+
+   //disabling leaves the registry rows in place, resync them with syncholders before enabling again
+   statstable.modify( st, same_payer, [&]( auto& s ) {
+      s.holder_registry.emplace( enabled );
+   });
+}
+
+//backfills the registry for holders that existed before it was enabled
+void token::syncholders( const symbol& sym, vector<name> owners )
+{
+   require_auth( _self );
+
+   stats statstable( _self, sym.code().raw() );
+   const auto& st = statstable.get( sym.code().raw(), "symbol does not exist" );
+   eosio_assert( st.supply.symbol == sym, "symbol precision mismatch" );
+   eosio_assert( st.holder_registry.value_or(), "holder registry is not enabled" );
+
+   for( const auto& owner : owners ) {
+      accounts acnts( _self, owner.value );
+      auto it = acnts.find( sym.code().raw() );
+      if( it == acnts.end() ) {
+         sync_holder( st, owner, asset( 0, sym ), true );
+      } else {
+         sync_holder( st, owner, it->balance, it->claimed );
+      }
+   }
+}
+
+//read only page of the registry in owner order, printed as json with the cursor of the next page
+void token::listholders( const symbol& sym, name cursor, uint32_t limit )
+{
+   eosio_assert( limit > 0 && limit <= 1000, "limit must be between 1 and 1000" );
+
+   holders registry( _self, sym.code().raw() );
+   auto it = registry.lower_bound( cursor.value );
+
+   print( "{\"rows\":[" );
+   for( uint32_t i = 0; i < limit && it != registry.end(); ++i, ++it ) {
+      if( i > 0 ) print( "," );
+      print( "[\"", it->owner, "\",\"" );
+      it->balance.print();
+      print( "\",", it->claimed ? "true" : "false", "]" );
+   }
+   print( "],\"more\":\"" );
+   if( it != registry.end() ) print( it->owner );
+   print( "\"}" );
+}
+
 void token::open( name owner, const symbol& symbol, name ram_payer )
 {
    require_auth( ram_payer );
@@ -233,6 +920,7 @@ void token::open( name owner, const symbol& symbol, name ram_payer )
    accounts acnts( _self, owner.value );
    auto it = acnts.find( sym_code_raw );
    if( it == acnts.end() ) {
+      //a zero balance row is no holder, the counters do not change
       acnts.emplace( ram_payer, [&]( auto& a ){
         a.balance = asset{0, symbol};
       });
@@ -249,9 +937,18 @@ void token::close( name owner, const symbol& symbol )
    acnts.erase( it );
 }
 
-void token::checktransfer( name from, asset value)
+//balance is the row of from as it was before the transfer
+void token::checktransfer( name from, asset value, const asset& balance )
 {
-  // send tokens
+  // the crowdsale only needs to know when untouched crowdsale tokens are spent
+  crowdsale_buyers buyerlist( "mptcrowdsale"_n, metpack::buyer_shard( from ) );
+  auto buyer = buyerlist.find( from.value );
+  if( buyer == buyerlist.end() || buyer->tokens_untouched.symbol != value.symbol ) return;
+
+  // tokens that did not come from the crowdsale cover the transfer
+  if( balance.amount - buyer->tokens_untouched.amount >= value.amount ) return;
+
+  // notify crowdsale
   action checkTransfer = action( 
       //permission_level
       permission_level(get_self(),"active"_n),
@@ -260,12 +957,12 @@ void token::checktransfer( name from, asset value)
       //action in target contract
       "chcktransfer"_n,
       //data
-      std::make_tuple(from, value, get_balance(get_self(), from, value.symbol.code()))
+      std::make_tuple(from, value, balance)
   );
 
-  checkTransfer.send();
+  metpack::send( checkTransfer );
 } 
 
 } /// namespace eosio
 
-EOSIO_DISPATCH( eosio::token, (create)(issue)(transfer)(open)(close)(retire)(claim)(recover)(update) )
+METPACK_DISPATCH( eosio::token, (create)(issue)(issuebatch)(queuedrop)(drain)(unqueue)(transfer)(transferbatch)(approve)(transferfrom)(open)(close)(retire)(claim)(recover)(update)(seedcounters)(recoverbatch)(recoversweep)(commitdrop)(claimdrop)(closedrop)(setregistry)(syncholders)(listholders) )
@@ -5,10 +5,19 @@
 #pragma once
 
 #include <eosiolib/asset.hpp>
+#include <eosiolib/binary_extension.hpp>
+#include <eosiolib/crypto.hpp>
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/symbol.hpp>
 
+#include "../common/buyer_shard.hpp"
+#include "../common/dispatch.hpp"
+#include "../common/instrument.hpp"
+
+#include <algorithm>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace eosiosystem {
    class system_contract;
@@ -17,6 +26,8 @@ namespace eosiosystem {
 namespace eosio {
 
    using std::string;
+   using std::vector;
+   using std::pair;
 
    class [[eosio::contract("metpacktoken")]] token : public contract {
       public:
@@ -33,12 +44,39 @@ namespace eosio {
          [[eosio::action]]
          void issue( name to, asset quantity, string memo );
 
+         [[eosio::action]]
+         void issuebatch( vector<pair<name, asset>> recipients, string memo );
+
+         [[eosio::action]]
+         void queuedrop( vector<pair<name, asset>> recipients );
+
+         [[eosio::action]]
+         void drain( const symbol& sym, uint32_t max_rows );
+
+         [[eosio::action]]
+         void unqueue( const symbol& sym, vector<uint64_t> ids );
+
          [[eosio::action]]
          void claim( name owner, const symbol& sym );
 
          [[eosio::action]]
          void recover( name owner, const symbol& sym );
 
+         [[eosio::action]]
+         void recoverbatch( const symbol& sym, vector<name> owners );
+
+         [[eosio::action]]
+         void recoversweep( const symbol& sym, name cursor, uint32_t max_rows );
+
+         [[eosio::action]]
+         void commitdrop( uint64_t drop_id, checksum256 root, asset total, uint64_t leaves );
+
+         [[eosio::action]]
+         void claimdrop( name owner, uint64_t drop_id, asset quantity, uint64_t index, vector<checksum256> proof );
+
+         [[eosio::action]]
+         void closedrop( const symbol& sym, uint64_t drop_id );
+
          [[eosio::action]]
          void retire( asset quantity, string memo );
 
@@ -48,6 +86,33 @@ namespace eosio {
                         asset   quantity,
                         string  memo );
 
+         [[eosio::action]]
+         void transferbatch( name    from,
+                             vector<pair<name, asset>> transfers,
+                             string  memo );
+
+         [[eosio::action]]
+         void approve( name owner, name spender, asset quantity );
+
+         [[eosio::action]]
+         void transferfrom( name    spender,
+                            name    from,
+                            name    to,
+                            asset   quantity,
+                            string  memo );
+
+         [[eosio::action]]
+         void seedcounters( const symbol& sym, uint64_t holders, asset claimed, asset unclaimed, asset circulating );
+
+         [[eosio::action]]
+         void setregistry( const symbol& sym, bool enabled );
+
+         [[eosio::action]]
+         void syncholders( const symbol& sym, vector<name> owners );
+
+         [[eosio::action]]
+         void listholders( const symbol& sym, name cursor, uint32_t limit );
+
          [[eosio::action]]
          void open( name owner, const symbol& symbol, name ram_payer );
 
@@ -61,6 +126,26 @@ namespace eosio {
             return st.supply;
          }
 
+         static uint64_t get_holder_count( name token_contract_account, symbol_code sym_code )
+         {
+            return get_counters( token_contract_account, sym_code ).holders;
+         }
+
+         static asset get_claimed_supply( name token_contract_account, symbol_code sym_code )
+         {
+            return get_counters( token_contract_account, sym_code ).claimed;
+         }
+
+         static asset get_unclaimed_supply( name token_contract_account, symbol_code sym_code )
+         {
+            return get_counters( token_contract_account, sym_code ).unclaimed;
+         }
+
+         static asset get_circulating_supply( name token_contract_account, symbol_code sym_code )
+         {
+            return get_counters( token_contract_account, sym_code ).circulating;
+         }
+
          static asset get_balance( name token_contract_account, name owner, symbol_code sym_code )
          {
             accounts accountstable( token_contract_account, owner.value );
@@ -68,7 +153,24 @@ namespace eosio {
             return ac.balance;
          }
 
+         static asset get_allowance( name token_contract_account, name owner, name spender, symbol_code sym_code )
+         {
+            allowances allowancetable( token_contract_account, owner.value );
+            auto byspender = allowancetable.get_index<"byspender"_n>();
+            auto it = byspender.find( allowance_key( spender, sym_code ) );
+            eosio_assert( it != byspender.end(), "no allowance found" );
+            return it->quantity;
+         }
+
       private:
+         //aggregates kept up to date by every balance change, circulating excludes the issuer, mptcrowdsale and the drop escrow
+         struct holder_counters {
+            uint64_t holders = 0;
+            asset    claimed;
+            asset    unclaimed;
+            asset    circulating;
+         };
+
          struct [[eosio::table]] account {
             asset    balance;
             bool     claimed = false;
@@ -79,18 +181,135 @@ namespace eosio {
             asset    supply;
             asset    max_supply;
             name     issuer;
+            binary_extension<bool> holder_registry;
+            binary_extension<holder_counters> counters;
 
             uint64_t primary_key()const { return supply.symbol.code().raw(); }
          };
 
-         typedef eosio::multi_index< "accounts"_n, account > accounts;
-         typedef eosio::multi_index< "stat"_n, currency_stats > stats;
+         //optional per symbol view of all holders, scoped by symbol code
+         struct [[eosio::table]] holder {
+            name     owner;
+            asset    balance;
+            bool     claimed = false;
+
+            uint64_t primary_key()const { return owner.value; }
+            uint64_t by_balance()const { return static_cast<uint64_t>( balance.amount ); }
+         };
+
+         //airdrop recipients waiting to be credited by drain, scoped by symbol code.
+         //reserved rows were added to the supply by queuedrop and sit in the drop escrow
+         struct [[eosio::table]] queued_drop {
+            uint64_t id;
+            name     to;
+            asset    quantity;
+            binary_extension<bool> reserved;
+
+            uint64_t primary_key()const { return id; }
+         };
+
+         static uint128_t allowance_key( name spender, symbol_code sym_code )
+         {
+            return ( static_cast<uint128_t>( spender.value ) << 64 ) | sym_code.raw();
+         }
+
+         //what spender may still move out of the owner balance with transferfrom, scoped by owner
+         struct [[eosio::table]] allowance {
+            uint64_t id;
+            name     spender;
+            asset    quantity;
+
+            uint64_t  primary_key()const { return id; }
+            uint128_t by_spender()const { return allowance_key( spender, quantity.symbol.code() ); }
+         };
+
+         //airdrop committed as the merkle root of its (index, owner, quantity) leaves, scoped by symbol code
+         struct [[eosio::table]] merkle_drop {
+            uint64_t    id;
+            checksum256 root;
+            uint64_t    leaves;
+            asset       total;
+            asset       claimed;
+
+            uint64_t primary_key()const { return id; }
+         };
+
+         //64 claimed flags of a merkle drop, scoped by symbol code, keyed by drop id and leaf index / 64
+         struct [[eosio::table]] drop_word {
+            uint64_t key;
+            uint64_t bits = 0;
+
+            uint64_t primary_key()const { return key; }
+         };
+
+         //read only mirror of mptcrowdsale::buyer, must match its layout
+         struct crowdsale_buyer {
+            name     buyer_name;
+            asset    tokens_untouched;
+
+            uint64_t primary_key()const { return buyer_name.value; }
+         };
+
+         typedef metpack::multi_index< "accounts"_n, account > accounts;
+         typedef metpack::multi_index< "stat"_n, currency_stats > stats;
+         typedef metpack::multi_index< "buyers"_n, crowdsale_buyer > crowdsale_buyers;
+         typedef metpack::multi_index< "dropqueue"_n, queued_drop > dropqueue;
+         typedef metpack::multi_index< "drops"_n, merkle_drop > drops;
+         typedef metpack::multi_index< "dropbits"_n, drop_word > dropbits;
+         typedef metpack::multi_index< "holders"_n, holder,
+            indexed_by< "bybalance"_n, const_mem_fun< holder, uint64_t, &holder::by_balance > >
+         > holders;
+         typedef metpack::multi_index< "allowances"_n, allowance,
+            indexed_by< "byspender"_n, const_mem_fun< allowance, uint128_t, &allowance::by_spender > >
+         > allowances;
+
+         //one account row of an action, looked up once, changed in memory and written back once by commit_balance
+         struct balance_cursor {
+            balance_cursor( name self, name owner, const symbol& sym );
 
-         void sub_balance( name owner, asset value );
-         void add_balance( name owner, asset value, name ram_payer, bool claimed );
-         void do_claim( name owner, const symbol& sym, name payer );
-         void checktransfer( name from, asset value );
+            accounts                 acnts;
+            accounts::const_iterator row;
+            name                     owner;
+            asset                    balance;
+            bool                     claimed = false;
+            name                     payer;               //same_payer unless the row changes hands or is new
+            bool                     drop_empty = false;  //erase the row if a debit empties it
+
+            bool found()const { return row != acnts.end(); }
+            void debit( const asset& value, name ram_payer, bool rebill );
+            void credit( const asset& value, name ram_payer, bool claim );
+            void claim_by( name new_payer );
+         };
+
+         void do_transfer( stats& statstable, const currency_stats& st, name from, name to, asset quantity, name ram_payer, bool rebill );
+         void commit_balance( const currency_stats& st, balance_cursor& cursor );
+         void sub_balance( const currency_stats& st, name owner, asset value );
+         void add_balance( const currency_stats& st, name owner, asset value, name ram_payer, bool claimed );
+         void do_claim( const currency_stats& st, name owner, name payer );
+         asset take_unclaimed( const currency_stats& st, name owner );
+         void sync_holder( const currency_stats& st, name owner, const asset& balance, bool claimed );
+         void count_balance( const currency_stats& st, name owner, int64_t delta, bool claimed );
+         void flush_counters( stats& statstable, const currency_stats& st );
+         void fund_escrow( const currency_stats& st, int64_t delta );
+         void checktransfer( name from, asset value, const asset& balance );
+
+         static holder_counters get_counters( name token_contract_account, symbol_code sym_code )
+         {
+            stats statstable( token_contract_account, sym_code.raw() );
+            const auto& st = statstable.get( sym_code.raw() );
+            eosio_assert( st.counters.has_value(), "holder counters are not seeded" );
+            return st.counters.value();
+         }
+
+         //changes to the counters of this action, written to the stat row once by flush_counters
+         struct counter_delta {
+            int64_t  holders = 0;
+            int64_t  claimed = 0;
+            int64_t  unclaimed = 0;
+            int64_t  circulating = 0;
+         };
 
+         counter_delta pending_counters;
    };
 
 } /// namespace eosio
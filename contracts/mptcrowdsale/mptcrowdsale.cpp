@@ -1,8 +1,21 @@
 #include <eosiolib/asset.hpp>
+#include <eosiolib/binary_extension.hpp>
 #include <eosiolib/eosio.hpp>
 // #include "override.hpp"
 
+#include "../common/buyer_shard.hpp"
+#include "../common/dispatch.hpp"
+#include "../common/instrument.hpp"
+#include "../common/transfer_notice.hpp"
+#include "pricing.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 using namespace eosio;
+using metpack::buyer_shard;
+using metpack::buyer_shards;
 
 class [[eosio::contract]] mptcrowdsale : public contract {
     public:
@@ -10,6 +23,15 @@ class [[eosio::contract]] mptcrowdsale : public contract {
 
         mptcrowdsale(name receiver, name code,  datastream<const char*> ds):contract(receiver, code, ds) {}
 
+        // Sale phase as given to setphases, a zero account_cap leaves it uncapped
+        struct phase_spec {
+            uint32_t    start;
+            uint64_t    rate;
+            uint64_t    ratedenom;
+            asset       allocation;
+            asset       account_cap;
+        };
+
         [[eosio::action]]
         void addtoken(  name        token_contract, 
                         name        owner,
@@ -26,6 +48,7 @@ class [[eosio::contract]] mptcrowdsale : public contract {
             require_auth(get_self());
             
             check( available_tokens.symbol.is_valid(), "invalid symbol name" );
+            check( rate > 0 && ratedenom > 0, "rate must be positive" );
             stats statstable( get_self(), get_self().value );
             auto existing = statstable.find( token_contract.value );
             check( existing == statstable.end(), "token already added" );
@@ -39,17 +62,349 @@ class [[eosio::contract]] mptcrowdsale : public contract {
                 s.funds_unlocked    = initial_funds;
                 s.rate              = rate;
                 s.ratedenom         = ratedenom;                
+                s.price.emplace( pricing::make_price( rate, ratedenom ) );
                 s.crowdsale_start   = crowdsale_start;
                 s.crowdsale_end     = crowdsale_end;
                 s.buyback_start     = buyback_start;
                 s.buyback_end       = buyback_end;          
             });
+            settle( token_contract );
+        }
+
+        // Fold the per shard sale and unlock counters into the stats row and
+        // split the remaining tokens evenly over the shards again. A buy that
+        // does not fit its shard borrows the spare allotment of the others
+        [[eosio::action]]
+        void settle( name token_contract )
+        {
+            stats statstable( get_self(), get_self().value );
+            const auto& token_entry = statstable.get( token_contract.value, "token not found");
+            shards shardtable( get_self(), token_contract.value );
+
+            asset available = token_entry.available_tokens;
+            asset funds = token_entry.funds_total;
+            int64_t eos_freed = 0;
+            int64_t legacy_unlocked = 0;
+            std::vector<sale_phase> phases = phases_of( token_entry );
+            for( auto it = shardtable.begin(); it != shardtable.end(); ++it )
+            {
+                available -= it->tokens_sold;
+                funds += it->funds_in;
+                // unlocks carry what their buyers paid, rows from before that
+                // only have the tokens
+                if( it->funds_unlocked.has_value() ) eos_freed += it->funds_unlocked.value().amount;
+                else legacy_unlocked += it->tokens_unlocked.amount;
+                // a shard sells from the phase it was last split for
+                if( !it->phase.has_value() ) continue;
+                for( auto& ph : phases )
+                {
+                    if( ph.start == it->phase.value() ) ph.sold += it->tokens_sold;
+                }
+            }
+            eos_freed += pricing::convert( price_of( token_entry ).funds_per_token, legacy_unlocked, pricing::rounding::down );
+
+            // a phased sale only splits what is left of the phase active now
+            asset remaining = available;
+            uint32_t active_start = 0;
+            if( !phases.empty() )
+            {
+                remaining.amount = 0;
+                if( now() >= phases.front().start )
+                {
+                    auto active = pricing::at_time( phases.begin(), phases.end(), now() );
+                    active_start = active->start;
+                    remaining.amount = std::max<int64_t>( 0, std::min( available.amount, active->allocation.amount - active->sold.amount ) );
+                }
+            }
+
+            const int64_t shard_count = buyer_shards;
+            asset allotment( remaining.amount / shard_count, available.symbol );
+            asset zero_funds( 0, funds.symbol );
+            for( uint64_t id = 0; id < buyer_shards; ++id )
+            {
+                // shard 0 also takes the remainder of the split
+                asset shard_allotment = allotment;
+                if( id == 0 ) shard_allotment.amount += remaining.amount % shard_count;
+
+                auto it = shardtable.find( id );
+                if( it == shardtable.end() )
+                {
+                    shardtable.emplace( get_self(), [&]( auto& row ) {
+                        row.id          = id;
+                        row.allotment   = shard_allotment;
+                        row.tokens_sold = asset( 0, available.symbol );
+                        row.funds_in    = zero_funds;
+                        row.tokens_unlocked = asset( 0, available.symbol );
+                        row.funds_unlocked.emplace( zero_funds );
+                        if( !phases.empty() ) row.phase.emplace( active_start );
+                    });
+                }
+                else
+                {
+                    shardtable.modify( it, get_self(), [&]( auto& row ) {
+                        row.allotment   = shard_allotment;
+                        row.tokens_sold.amount = 0;
+                        row.funds_in    = zero_funds;
+                        row.tokens_unlocked.amount = 0;
+                        // extensions are read in order, the unlocked funds come before the phase
+                        row.funds_unlocked.emplace( zero_funds );
+                        if( !phases.empty() ) row.phase.emplace( active_start );
+                    });
+                }
+            }
+
+            statstable.modify( token_entry, get_self(), [&]( auto& row ) {
+                row.available_tokens = available;
+                row.funds_total = funds;
+                row.funds_unlocked.amount += eos_freed;
+                if( !phases.empty() ) row.phases.emplace( phases );
+            });
+        }
+
+        // Replace the sale phases, sorted by start. Phases that keep their
+        // start keep what they have sold, so phases can be changed while the
+        // sale runs. Takes effect through the settle it ends with
+        [[eosio::action]]
+        void setphases( name token_contract, std::vector<phase_spec> specs )
+        {
+            require_auth(get_self());
+            // fold the pending shard sales first, so sold is current for the
+            // allocation checks and nothing is lost when a start moves
+            settle( token_contract );
+            stats statstable( get_self(), get_self().value );
+            const auto& token_entry = statstable.get( token_contract.value, "token not found");
+            const auto sym = token_entry.available_tokens.symbol;
+            std::vector<sale_phase> current = phases_of( token_entry );
+
+            std::vector<sale_phase> phases;
+            phases.reserve( specs.size() );
+            for( size_t i = 0; i < specs.size(); ++i )
+            {
+                const auto& spec = specs[i];
+                check( i == 0 || specs[i - 1].start < spec.start, "phases must be sorted by start" );
+                check( spec.rate > 0 && spec.ratedenom > 0, "rate must be positive" );
+                check( spec.allocation.symbol == sym && spec.allocation.amount >= 0, "invalid phase allocation" );
+                check( spec.account_cap.symbol == sym && spec.account_cap.amount >= 0, "invalid phase account cap" );
+
+                asset sold( 0, sym );
+                for( const auto& ph : current )
+                {
+                    if( ph.start == spec.start ) sold = ph.sold;
+                }
+                check( sold <= spec.allocation, "phase allocation is below what it has sold" );
+                phases.push_back( sale_phase{ spec.start, pricing::make_price( spec.rate, spec.ratedenom ),
+                                              spec.allocation, spec.account_cap, sold } );
+            }
+
+            statstable.modify( token_entry, get_self(), [&]( auto& row ) {
+                // extensions are read in order, the ones before the phases have to be present
+                if( !row.price.has_value() ) row.price.emplace( pricing::make_price( row.rate, row.ratedenom ) );
+                if( !row.order_queue.has_value() ) row.order_queue.emplace( false );
+                row.phases.emplace( phases );
+            });
+            settle( token_contract );
+        }
+
+        // Move buyer rows from before sharding out of the contract scope,
+        // run in the same transaction as the code update together with a
+        // settle, which creates the shard rows buys draw their allotment from
+        [[eosio::action]]
+        void movebuyers( uint32_t max_rows )
+        {
+            require_auth(get_self());
+            buyers legacy( get_self(), get_self().value );
+            auto it = legacy.begin();
+            for( uint32_t i = 0; i < max_rows && it != legacy.end(); ++i )
+            {
+                buyers buyerlist( get_self(), buyer_shard( it->buyer_name ) );
+                buyerlist.emplace( get_self(), [&]( auto& row ) {
+                    row.buyer_name = it->buyer_name;
+                    row.tokens_untouched = it->tokens_untouched;
+                });
+                it = legacy.erase( it );
+            }
+        }
+
+        // Queue mode records each buy as an order row and leaves the payout
+        // to fillorders, so a buy during the opening rush is one row write
+        [[eosio::action]]
+        void setqueue( name token_contract, bool enabled )
+        {
+            require_auth(get_self());
+            stats statstable( get_self(), get_self().value );
+            const auto& token_entry = statstable.get( token_contract.value, "token not found");
+            statstable.modify( token_entry, get_self(), [&]( auto& row ) {
+                // extensions are read in order, the price has to be present before the flag
+                if( !row.price.has_value() ) row.price.emplace( pricing::make_price( row.rate, row.ratedenom ) );
+                row.order_queue.emplace( enabled );
+            });
+        }
+
+        // Fill up to max_rows queued orders of one shard, the shard row and
+        // each payout row are written once per batch. Anyone may run it,
+        // orders are only ever filled or refunded, and refunded only when
+        // their phase has ended or the whole sale cannot cover them. Nothing
+        // is sent here, each buyer collects with claimorder, so a buyer that
+        // rejects its transfer cannot hold up the queue behind it
+        [[eosio::action]]
+        void fillorders( uint64_t shard_id, uint32_t max_rows )
+        {
+            check( shard_id < buyer_shards, "invalid shard" );
+            check( max_rows > 0, "max_rows must be positive" );
+            stats statstable( get_self(), get_self().value );
+            const auto& token_entry = statstable.get( name("metpacktoken").value, "token not found");
+            shards shardtable( get_self(), token_entry.token_contract.value );
+            orders orderlist( get_self(), shard_id );
+            auto it = orderlist.begin();
+            check( it != orderlist.end(), "no orders queued" );
+
+            // orders fill from the allotment of the phase active now, as direct buys do
+            bool phased = token_entry.phases.has_value() && !token_entry.phases.value().empty();
+            uint32_t active_start = 0;
+            if( phased )
+            {
+                const auto& phases = token_entry.phases.value();
+                active_start = pricing::at_time( phases.begin(), phases.end(), now() )->start;
+            }
+            auto shard_it = shardtable.find( shard_id );
+            if( shard_it == shardtable.end() || ( phased && shard_it->phase.value_or() != active_start ) )
+            {
+                // the first fill after a phase boundary splits the new phase itself
+                settle( token_entry.token_contract );
+                fillorders( shard_id, max_rows );
+                return;
+            }
+            const auto& sh = *shard_it;
+
+            asset sold( 0, sh.tokens_sold.symbol );
+            asset funds( 0, sh.funds_in.symbol );
+            int64_t borrowed = 0;
+            std::vector<fill> fills;
+            buyers buyerlist( get_self(), shard_id );
+            for( uint32_t i = 0; i < max_rows && it != orderlist.end(); ++i )
+            {
+                // an order priced in a phase that has ended cannot be filled at its price,
+                // one the whole sale cannot cover any more will never be
+                bool fits = it->phase.has_value() == phased && ( !phased || it->phase.value() == active_start );
+                int64_t missing = sh.tokens_sold.amount + sold.amount + it->tokens.amount - sh.allotment.amount - borrowed;
+                if( fits && missing > 0 )
+                {
+                    int64_t more = borrow_allotment( shardtable, sh, missing );
+                    if( more < 0 ) fits = false;
+                    else borrowed += more;
+                }
+                if( !fits )
+                {
+                    release_order( buyerlist, *it );
+                    fills.push_back( fill{ it->buyer_name, asset( 0, it->tokens.symbol ), asset( 0, it->payment.symbol ), it->payment } );
+                    it = orderlist.erase( it );
+                    continue;
+                }
+                sold += it->tokens;
+                funds += it->payment;
+                fills.push_back( fill{ it->buyer_name, it->tokens, it->payment, asset( 0, it->payment.symbol ) } );
+                it = orderlist.erase( it );
+            }
+
+            if( !fills.empty() )
+            {
+                // one payout row write per buyer however many orders it placed
+                std::sort( fills.begin(), fills.end(), []( const auto& a, const auto& b ) {
+                    return a.buyer_name < b.buyer_name;
+                });
+                size_t merged = 0;
+                for( size_t i = 1; i < fills.size(); ++i )
+                {
+                    if( fills[i].buyer_name == fills[merged].buyer_name )
+                    {
+                        fills[merged].tokens += fills[i].tokens;
+                        fills[merged].funds += fills[i].funds;
+                        fills[merged].refund += fills[i].refund;
+                    }
+                    else fills[++merged] = fills[i];
+                }
+                fills.resize( merged + 1 );
+
+                if( sold.amount > 0 )
+                {
+                    shardtable.modify( sh, get_self(), [&]( auto& row ) {
+                        row.allotment.amount += borrowed;
+                        row.tokens_sold += sold;
+                        row.funds_in += funds;
+                    });
+                }
+
+                payouts payoutlist( get_self(), shard_id );
+                for( const auto& f : fills )
+                {
+                    auto owed = payoutlist.find( f.buyer_name.value );
+                    if( owed == payoutlist.end() )
+                    {
+                        payoutlist.emplace( get_self(), [&]( auto& row ) {
+                            row.buyer_name = f.buyer_name;
+                            row.tokens = f.tokens;
+                            row.funds = f.funds;
+                            row.refund = f.refund;
+                        });
+                    }
+                    else
+                    {
+                        payoutlist.modify( owed, get_self(), [&]( auto& row ) {
+                            row.tokens += f.tokens;
+                            row.funds += f.funds;
+                            row.refund += f.refund;
+                        });
+                    }
+                }
+            }
+
+            print( "{\"buyers\":", static_cast<uint32_t>( fills.size() ), ",\"more\":", it != orderlist.end() ? "true" : "false", "}" );
+        }
+
+        // Pay a buyer what fillorders set aside for it, the filled tokens and
+        // the payments of refunded orders. Anyone may run it, the buyer row
+        // is credited here so the tokens only count as untouched once the
+        // buyer holds them
+        [[eosio::action]]
+        void claimorder( name buyer_name )
+        {
+            uint64_t shard_id = buyer_shard( buyer_name );
+            payouts payoutlist( get_self(), shard_id );
+            const auto& owed = payoutlist.get( buyer_name.value, "nothing to claim" );
+            const fill f{ owed.buyer_name, owed.tokens, owed.funds, owed.refund };
+            payoutlist.erase( owed );
+
+            if( f.tokens.amount > 0 )
+            {
+                // phase purchases were counted when the orders came in
+                buyers buyerlist( get_self(), shard_id );
+                credit_buyer( buyerlist, buyer_name, f.tokens, f.funds, nullptr, asset( 0, f.tokens.symbol ) );
+                action sendTokens = action(
+                    permission_level(get_self(), name("active")),
+                    name("metpacktoken"),
+                    name("transfer"),
+                    std::make_tuple(get_self(), buyer_name, f.tokens, std::string("MPT_crowdsale_buy"))
+                );
+                metpack::send( sendTokens );
+            }
+            if( f.refund.amount > 0 )
+            {
+                action refund = action(
+                    permission_level(get_self(), name("active")),
+                    name("eosio.token"),
+                    name("transfer"),
+                    std::make_tuple(get_self(), buyer_name, f.refund, std::string("MPT_crowdsale_refund"))
+                );
+                metpack::send( refund );
+            }
         }
 
         [[eosio::action]]
         void claimfunds( name token_contract )
         {
             require_auth(token_contract);
+            // pick up unlocks still pending in the shards
+            settle( token_contract );
             stats statstable( get_self(), get_self().value );            
             const auto& token_entry = statstable.get( token_contract.value, "token not found");
             check(token_entry.funds_unlocked.amount > 0, "No unlocked funds available");
@@ -74,7 +429,7 @@ class [[eosio::contract]] mptcrowdsale : public contract {
                 std::make_tuple(get_self(), token_entry.owner, claimed_funds, std::string("claim_unlocked_funds"))
             );
 
-            transfer_eos.send();
+            metpack::send( transfer_eos );
         }
 
         [[eosio::action]]
@@ -82,7 +437,7 @@ class [[eosio::contract]] mptcrowdsale : public contract {
         {
             require_auth( name("metpacktoken") );
             // Check amount of untouched tokens
-            buyers buyerlist( get_self(), get_self().value );
+            buyers buyerlist( get_self(), buyer_shard( from_account ) );
             auto iterator = buyerlist.find( from_account.value );            
             if ( iterator == buyerlist.end() )
             {
@@ -97,7 +452,11 @@ class [[eosio::contract]] mptcrowdsale : public contract {
                 if (freetokens >= amount.amount) return; // Airdrop amount covers transaction
                 // substract remaining from untouched tokens
                 uint64_t tokens_to_substract = amount.amount - freetokens;
-                if( tokens_to_substract == from.tokens_untouched.amount) 
+                // the funds the buyer paid for these tokens are unlocked at its own price
+                asset paid = funds_of( from );
+                asset freed = funds_for( from, paid, tokens_to_substract );
+                // rows counting phase purchases stay to keep the account cap
+                if( tokens_to_substract == from.tokens_untouched.amount && !from.purchase.has_value() ) 
                 {
                     buyerlist.erase( from );
                 }
@@ -105,36 +464,23 @@ class [[eosio::contract]] mptcrowdsale : public contract {
                 {
                     buyerlist.modify( from , get_self(), [&]( auto& row ) {
                         row.tokens_untouched.amount -= tokens_to_substract;
+                        row.funds_untouched.emplace( paid - freed );
                     });
-                    unlockeos( tokens_to_substract );
-                }                
+                }
+                unlockeos( buyer_shard( from_account ), tokens_to_substract, freed );
             }
         }    
 
-        void transfer(uint64_t sender, uint64_t receiver) 
+        void transfer( const metpack::transfer_notice& data ) 
         {   
-            struct transfer_t {
-                name from;
-                name to;
-                asset quantity;
-                std::string memo;
-            } 
-            data = unpack_action_data<transfer_t>();                     
             if (data.from != get_self() && data.to == get_self()) 
             {                
                 buytokens(data.from, data.quantity);
             }
         }
 
-        void processreturn(uint64_t sender, uint64_t receiver) 
+        void processreturn( const metpack::transfer_notice& data ) 
         {   
-            struct transfer_t {
-                name from;
-                name to;
-                asset quantity;
-                std::string memo;
-            } 
-            data = unpack_action_data<transfer_t>();                     
             if (data.from != get_self() && data.from != name("metpacktoken") && data.to == get_self()) 
             {                
                 returntokens(data.from, data.quantity);
@@ -144,6 +490,22 @@ class [[eosio::contract]] mptcrowdsale : public contract {
         
 
     private:      
+        // One step of a tiered sale, active from start until the next phase
+        // starts. A zero account_cap leaves the phase uncapped
+        struct sale_phase {
+            uint32_t        start;
+            pricing::price  price;
+            asset           allocation;
+            asset           account_cap;
+            asset           sold;
+        };
+
+        // tokens one buyer bought in a capped phase
+        struct phase_purchase {
+            uint32_t    phase_start;
+            asset       bought;
+        };
+
         struct [[eosio::table]] token {
             name     token_contract;
             name     owner;
@@ -157,30 +519,180 @@ class [[eosio::contract]] mptcrowdsale : public contract {
             uint32_t crowdsale_end;
             uint32_t buyback_start;
             uint32_t buyback_end;                 
+            binary_extension<pricing::price> price;
+            binary_extension<bool> order_queue;
+            binary_extension<std::vector<sale_phase>> phases;
 
             uint64_t primary_key() const { return token_contract.value; }
         };
 
+        // metpacktoken reads this table in place, keep its crowdsale_buyer mirror
+        // in sync. The mirror ignores fields added at the end. funds_untouched
+        // is what the untouched tokens were paid, returns and unlocks give it
+        // back pro rata
         struct [[eosio::table]] buyer {
             name    buyer_name;
             asset   tokens_untouched;                               
+            binary_extension<asset>          funds_untouched;
+            binary_extension<phase_purchase> purchase;
 
             uint64_t primary_key() const { return buyer_name.value; }
         };
 
-        typedef eosio::multi_index< name("stats"), token > stats;
-        typedef eosio::multi_index< name("buyers"), buyer> buyers;
+        // Sale counters of one buyer shard, scoped by token contract. Buys only
+        // write their own shard, settle folds the counters into the stats row
+        struct [[eosio::table]] shard {
+            uint64_t id;
+            asset    allotment;
+            asset    tokens_sold;
+            asset    funds_in;
+            asset    tokens_unlocked;
+            binary_extension<asset>    funds_unlocked;
+            binary_extension<uint32_t> phase;
+
+            uint64_t primary_key() const { return id; }
+        };
+
+        // Buy waiting for fillorders in queue mode, scoped by buyer shard. The
+        // tokens are priced when the payment comes in, in the phase of phase.
+        // counted is set when they were counted against the phase account cap
+        struct [[eosio::table]] order {
+            uint64_t id;
+            name     buyer_name;
+            asset    payment;
+            asset    tokens;
+            binary_extension<uint32_t> phase;
+            binary_extension<bool>     counted;
 
-        void unlockeos( uint64_t amount )
+            uint64_t primary_key() const { return id; }
+        };
+
+        // What fillorders set aside for a buyer until it runs claimorder,
+        // scoped by buyer shard. funds is what was paid for tokens, refund
+        // the payments of orders that could not be filled
+        struct [[eosio::table]] payout {
+            name    buyer_name;
+            asset   tokens;
+            asset   funds;
+            asset   refund;
+
+            uint64_t primary_key() const { return buyer_name.value; }
+        };
+
+        // queued orders of one buyer filled or refunded in the same batch
+        struct fill {
+            name    buyer_name;
+            asset   tokens;
+            asset   funds;
+            asset   refund;
+        };
+
+        typedef metpack::multi_index< name("stats"), token > stats;
+        typedef metpack::multi_index< name("buyers"), buyer> buyers;
+        typedef metpack::multi_index< name("shards"), shard> shards;
+        typedef metpack::multi_index< name("orders"), order> orders;
+        typedef metpack::multi_index< name("payouts"), payout> payouts;
+
+        // Both conversions round down, so a buy followed by a full return
+        // never pays out more than was paid in. Rows stored before the price
+        // was precomputed get it computed here.
+        static pricing::price price_of( const token& t )
         {
+            return t.price.has_value() ? t.price.value() : pricing::make_price( t.rate, t.ratedenom );
+        }
+
+        static std::vector<sale_phase> phases_of( const token& t )
+        {
+            return t.phases.has_value() ? t.phases.value() : std::vector<sale_phase>();
+        }
+
+        // What a buyer paid for its untouched tokens. Rows from before this
+        // was stored bought at the base rate
+        asset funds_of( const buyer& b )
+        {
+            if( b.funds_untouched.has_value() ) return b.funds_untouched.value();
             stats statstable( get_self(), get_self().value );
-            const auto& st = statstable.get( name("metpacktoken").value, "token not found" );
-            uint64_t eos_freed = amount * st.ratedenom / st.rate;
-            statstable.modify(statstable.begin(), get_self(), [&]( auto& row ){
-                row.funds_unlocked.amount += eos_freed;
+            const auto& t = statstable.get( name("metpacktoken").value, "token not found");
+            return asset( pricing::convert( price_of( t ).funds_per_token, b.tokens_untouched.amount, pricing::rounding::down ),
+                          t.funds_total.symbol );
+        }
+
+        // Share of paid for amount of the buyer's untouched tokens, rounded
+        // down. The last tokens take what rounding left over, so a buyer that
+        // returns or moves everything gets back exactly what it paid
+        static asset funds_for( const buyer& b, asset paid, int64_t amount )
+        {
+            if( amount >= b.tokens_untouched.amount ) return paid;
+            paid.amount = pricing::convert( pricing::make_ratio( paid.amount, b.tokens_untouched.amount ), amount, pricing::rounding::down );
+            return paid;
+        }
+
+        // Unlocks are only recorded in the buyer's shard, settle adds them
+        // to funds_unlocked instead of writing the stats row here
+        void unlockeos( uint64_t shard_id, uint64_t amount, const asset& funds )
+        {
+            shards shardtable( get_self(), name("metpacktoken").value );
+            auto sh = shardtable.find( shard_id );
+            if( sh == shardtable.end() )
+            {
+                // a transfer must not wait for a settle, the row starts out
+                // without allotment and the next settle folds the unlock
+                stats statstable( get_self(), get_self().value );
+                const auto& token_entry = statstable.get( name("metpacktoken").value, "token not found");
+                const auto sym = token_entry.available_tokens.symbol;
+                shardtable.emplace( get_self(), [&]( auto& row ) {
+                    row.id              = shard_id;
+                    row.allotment       = asset( 0, sym );
+                    row.tokens_sold     = asset( 0, sym );
+                    row.funds_in        = asset( 0, token_entry.funds_total.symbol );
+                    row.tokens_unlocked = asset( amount, sym );
+                    row.funds_unlocked.emplace( funds );
+                });
+                return;
+            }
+            asset unlocked = funds;
+            if( !sh->funds_unlocked.has_value() )
+            {
+                // tokens unlocked before the funds were tracked, at the base rate
+                stats statstable( get_self(), get_self().value );
+                const auto& token_entry = statstable.get( name("metpacktoken").value, "token not found");
+                unlocked.amount += pricing::convert( price_of( token_entry ).funds_per_token, sh->tokens_unlocked.amount, pricing::rounding::down );
+            }
+            else unlocked += sh->funds_unlocked.value();
+            shardtable.modify( sh, get_self(), [&]( auto& row ){
+                row.tokens_unlocked.amount += amount;
+                row.funds_unlocked.emplace( unlocked );
             });
         }
 
+        // A purchase bigger than what is left of its shard takes the spare
+        // allotment of the other shards split for the same phase, so the even
+        // split never caps the size of a purchase. Returns what was moved
+        // over, or -1 when all shards together cannot cover missing
+        int64_t borrow_allotment( shards& shardtable, const shard& sh, int64_t missing )
+        {
+            auto spare_of = [&]( const shard& other ) -> int64_t {
+                if( other.id == sh.id || other.phase.value_or() != sh.phase.value_or() ) return 0;
+                return std::max<int64_t>( 0, other.allotment.amount - other.tokens_sold.amount );
+            };
+
+            int64_t spare = 0;
+            for( auto it = shardtable.begin(); it != shardtable.end() && spare < missing; ++it ) spare += spare_of( *it );
+            if( spare < missing ) return -1;
+
+            int64_t borrowed = 0;
+            for( auto it = shardtable.begin(); borrowed < missing; ++it )
+            {
+                int64_t take = std::min( spare_of( *it ), missing - borrowed );
+                if( take == 0 ) continue;
+                shardtable.modify( it, get_self(), [&]( auto& row ) {
+                    row.allotment.amount -= take;
+                });
+                borrowed += take;
+            }
+            return borrowed;
+        }
+
         void buytokens( name buyer_name, asset payment )
         {
             // Checks
@@ -193,15 +705,69 @@ class [[eosio::contract]] mptcrowdsale : public contract {
             // Check timestamp
             check(now() > token_entry.crowdsale_start, "crowdsale has not started");
             check(now() < token_entry.crowdsale_end, "crowdsale period is over");
+            // the active phase comes out of the stats row, no further reads
+            const sale_phase* ph = nullptr;
+            pricing::ratio rate = price_of( token_entry ).tokens_per_fund;
+            if( token_entry.phases.has_value() && !token_entry.phases.value().empty() )
+            {
+                const auto& phases = token_entry.phases.value();
+                ph = &*pricing::at_time( phases.begin(), phases.end(), now() );
+                rate = ph->price.tokens_per_fund;
+            }
             // calculate tokens to send and check available amount
-            int64_t token_amount = payment.amount * token_entry.rate / token_entry.ratedenom;
+            int64_t token_amount = pricing::convert( rate, payment.amount, pricing::rounding::down );
+            check(token_amount > 0, "payment too small");
             asset tokens_bought(token_amount, token_entry.available_tokens.symbol);
-            check(tokens_bought <= token_entry.available_tokens, "not enough tokens available");
+            uint64_t shard_id = buyer_shard( buyer_name );
 
-            // modify funds in stat table
-            statstable.modify( token_entry, get_self(), [&]( auto& row ) {
-                row.funds_total += payment;
-                row.available_tokens -= tokens_bought;
+            if( token_entry.order_queue.value_or() )
+            {
+                // a capped phase counts the purchase now, before the order is filled
+                bool counted = ph && ph->account_cap.amount > 0;
+                if( counted )
+                {
+                    buyers buyerlist(get_self(), shard_id);
+                    credit_buyer( buyerlist, buyer_name, asset( 0, tokens_bought.symbol ), asset( 0, payment.symbol ), ph, tokens_bought );
+                }
+                orders orderlist( get_self(), shard_id );
+                auto id = orderlist.available_primary_key();
+                orderlist.emplace( get_self(), [&]( auto& row ) {
+                    row.id = id;
+                    row.buyer_name = buyer_name;
+                    row.payment = payment;
+                    row.tokens = tokens_bought;
+                    if( ph )
+                    {
+                        row.phase.emplace( ph->start );
+                        row.counted.emplace( counted );
+                    }
+                });
+                return;
+            }
+
+            // only the buyer's shard is written, settle folds it into the stat table
+            shards shardtable( get_self(), token_entry.token_contract.value );
+            auto shard_it = shardtable.find( shard_id );
+            if( shard_it == shardtable.end() || ( ph && shard_it->phase.value_or() != ph->start ) )
+            {
+                // the first buy after a phase boundary splits the new phase
+                // itself, so buys never wait for a separate settle
+                settle( token_entry.token_contract );
+                buytokens( buyer_name, payment );
+                return;
+            }
+            const auto& sh = *shard_it;
+            int64_t borrowed = 0;
+            int64_t missing = sh.tokens_sold.amount + tokens_bought.amount - sh.allotment.amount;
+            if( missing > 0 )
+            {
+                borrowed = borrow_allotment( shardtable, sh, missing );
+                check(borrowed >= 0, "not enough tokens available");
+            }
+            shardtable.modify( sh, get_self(), [&]( auto& row ) {
+                row.allotment.amount += borrowed;
+                row.tokens_sold += tokens_bought;
+                row.funds_in += payment;
             });
             
             // send tokens
@@ -216,22 +782,62 @@ class [[eosio::contract]] mptcrowdsale : public contract {
                 std::make_tuple(get_self(), buyer_name, tokens_bought, std::string("MPT_crowdsale_buy"))
             );
 
-            sendTokens.send();
-            // add/update account to/in buyers
-            buyers buyerlist(get_self(), get_self().value);
+            metpack::send( sendTokens );
+            buyers buyerlist(get_self(), shard_id);
+            credit_buyer( buyerlist, buyer_name, tokens_bought, payment, ph, tokens_bought );
+        }
+
+        // Hands the cap room a refunded order took back to the buyer, the
+        // payment itself goes back with claimorder
+        void release_order( buyers& buyerlist, const order& o )
+        {
+            if( !o.counted.value_or() ) return;
+            auto iterator = buyerlist.find( o.buyer_name.value );
+            if( iterator == buyerlist.end() || !iterator->purchase.has_value() ) return;
+            if( iterator->purchase.value().phase_start != o.phase.value() ) return;
+            buyerlist.modify( iterator, get_self(), [&]( auto& row ) {
+                phase_purchase counted = row.purchase.value();
+                counted.bought.amount -= std::min( counted.bought.amount, o.tokens.amount );
+                row.purchase.emplace( counted );
+            });
+        }
+
+        // add/update account to/in buyers, a purchase in a capped phase is
+        // checked against the cap and counted in the same write
+        void credit_buyer( buyers& buyerlist, name buyer_name, const asset& tokens_bought, const asset& funds_paid,
+                           const sale_phase* ph, const asset& purchased )
+        {
             auto iterator = buyerlist.find(buyer_name.value);
+            bool capped = ph && ph->account_cap.amount > 0;
+            phase_purchase counted{ 0, asset( 0, purchased.symbol ) };
+            if( capped )
+            {
+                counted.phase_start = ph->start;
+                // what was bought in earlier phases does not count against this one
+                if( iterator != buyerlist.end() && iterator->purchase.has_value() && iterator->purchase.value().phase_start == ph->start )
+                {
+                    counted.bought = iterator->purchase.value().bought;
+                }
+                counted.bought += purchased;
+                check(counted.bought <= ph->account_cap, "purchase exceeds the account cap of the sale phase");
+            }
             if (iterator == buyerlist.end() )
             {
                 // add buyer to table
                 buyerlist.emplace(get_self(), [&]( auto& row ){
                     row.buyer_name = buyer_name;
                     row.tokens_untouched = tokens_bought;
+                    row.funds_untouched.emplace( funds_paid );
+                    if( capped ) row.purchase.emplace( counted );
                 });
             }
             else
             {
+                asset paid = funds_of( *iterator ) + funds_paid;
                 buyerlist.modify(iterator, get_self(), [&]( auto& row ) {
                     row.tokens_untouched += tokens_bought;
+                    row.funds_untouched.emplace( paid );
+                    if( capped ) row.purchase.emplace( counted );
                 });
             }
         }
@@ -245,19 +851,21 @@ class [[eosio::contract]] mptcrowdsale : public contract {
             check(now() < st.buyback_end, "buyback period is over");
             // check amount
             check(amount.symbol == st.available_tokens.symbol, "wrong token symbol");
-            buyers buyerlist( get_self(), get_self().value );            
+            buyers buyerlist( get_self(), buyer_shard( from_account ) );            
             const auto& from = buyerlist.get( from_account.value, "only untraded crowdsale tokens are accepted");
             check(amount <= from.tokens_untouched, "not enough valid tokens");
+            // the buyer gets back what it paid for these tokens
+            asset paid = funds_of( from );
+            asset eos_to_return = funds_for( from, paid, amount.amount );
             // edit untouched tokens
-            if (amount == from.tokens_untouched) buyerlist.erase( from );
+            if (amount == from.tokens_untouched && !from.purchase.has_value()) buyerlist.erase( from );
             else
             {
                 buyerlist.modify( from, get_self(), [&]( auto& row ) {
                     row.tokens_untouched -= amount;
+                    row.funds_untouched.emplace( paid - eos_to_return );
                 });
             }
-            // calculate amount of EOS to return and edit funds
-            asset eos_to_return(amount.amount * st.ratedenom / st.rate, st.funds_total.symbol);
             statstable.modify( st, get_self(), [&]( auto& s ){
                 s.funds_total -= eos_to_return;
             });
@@ -272,28 +880,14 @@ class [[eosio::contract]] mptcrowdsale : public contract {
                 //data
                 std::make_tuple(get_self(), from_account, eos_to_return, std::string("mpt_buyback"))
             );
-            transfer_eos.send();
+            metpack::send( transfer_eos );
         }
 };
 
-extern "C" void apply(uint64_t receiver, uint64_t code, uint64_t action) 
-{
-    if( action == name("transfer").value && code == name("eosio.token").value ) 
-    {
-        execute_action<mptcrowdsale>( name(receiver), name(code),&mptcrowdsale::transfer );
-    }
-    else if ( action == name("transfer").value && code == name("metpacktoken").value)
-    {
-        execute_action<mptcrowdsale>( name(receiver), name(code),&mptcrowdsale::processreturn );
-    }
-    else if( code == receiver ) 
-    {
-        switch( action ) {
-        EOSIO_DISPATCH_HELPER( mptcrowdsale, (addtoken) (chcktransfer) (claimfunds) );
-    }                                       
-  }
-}
-
-
-
+// Transfer notifications skip execute_action, which would copy the whole
+// action data including the memo, and decode only the head they need
+using crowdsale_notifications = metpack::notifications<
+    metpack::on_notify< "eosio.token"_n.value, "transfer"_n.value, &mptcrowdsale::transfer >,
+    metpack::on_notify< "metpacktoken"_n.value, "transfer"_n.value, &mptcrowdsale::processreturn > >;
 
+METPACK_DISPATCH_NOTIFY( mptcrowdsale, (addtoken) (settle) (movebuyers) (setqueue) (setphases) (fillorders) (claimorder) (chcktransfer) (claimfunds), crowdsale_notifications )
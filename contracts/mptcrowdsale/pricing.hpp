@@ -0,0 +1,121 @@
+#pragma once
+
+#include <eosiolib/asset.hpp>
+#include <eosiolib/system.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+// Exact crowdsale rate arithmetic. Conversions multiply into 128 bits and
+// divide with a reciprocal that is precomputed when a rate is stored, so a
+// buy or a return never overflows and never runs a 128 bit division.
+namespace pricing {
+
+    using uint128 = unsigned __int128;
+
+    enum class rounding : uint8_t { down, up, nearest };
+
+    // num / den reduced, with the reciprocal of den shifted to have its top bit set
+    struct ratio {
+        uint64_t num   = 0;
+        uint64_t den   = 1;
+        uint64_t recip = 0;
+        uint8_t  shift = 0;
+    };
+
+    // both directions of a sale rate, funds to tokens and tokens to funds
+    struct price {
+        ratio tokens_per_fund;
+        ratio funds_per_token;
+    };
+
+    struct quotient {
+        uint64_t quot;
+        uint64_t rem;
+    };
+
+    constexpr uint64_t gcd( uint64_t a, uint64_t b )
+    {
+        while( b != 0 )
+        {
+            uint64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // den must be positive
+    constexpr ratio make_ratio( uint64_t num, uint64_t den )
+    {
+        uint64_t g = gcd( num, den );
+        num /= g;
+        den /= g;
+
+        uint8_t shift = __builtin_clzll( den );
+        uint64_t d = den << shift;
+        // floor((2^128 - 1) / d) - 2^64, always fits 64 bits for a normalized d
+        uint64_t recip = static_cast<uint64_t>( ( ( uint128( ~d ) << 64 ) | ~uint64_t(0) ) / d );
+        return ratio{ num, den, recip, shift };
+    }
+
+    constexpr price make_price( uint64_t rate, uint64_t ratedenom )
+    {
+        return price{ make_ratio( rate, ratedenom ), make_ratio( ratedenom, rate ) };
+    }
+
+    // n / den for n < den * 2^64, Moller and Granlund "Improved division by
+    // invariant integers", algorithm 4
+    constexpr quotient divide( const ratio& r, uint128 n )
+    {
+        uint64_t d  = r.den << r.shift;
+        uint128  u  = n << r.shift;
+        uint64_t u1 = static_cast<uint64_t>( u >> 64 );
+        uint64_t u0 = static_cast<uint64_t>( u );
+
+        uint128  q  = uint128( r.recip ) * u1 + u;
+        uint64_t q1 = static_cast<uint64_t>( q >> 64 ) + 1;
+        uint64_t q0 = static_cast<uint64_t>( q );
+        uint64_t rem = u0 - q1 * d;
+        if( rem > q0 )
+        {
+            --q1;
+            rem += d;
+        }
+        if( rem >= d )
+        {
+            ++q1;
+            rem -= d;
+        }
+        return quotient{ q1, rem >> r.shift };
+    }
+
+    // amount * num / den rounded as asked, checked to fit an asset amount
+    inline int64_t convert( const ratio& r, int64_t amount, rounding mode )
+    {
+        eosio::check( amount >= 0, "cannot convert a negative amount" );
+        uint128 n = uint128( static_cast<uint64_t>( amount ) ) * r.num;
+        eosio::check( static_cast<uint64_t>( n >> 64 ) < r.den, "price conversion overflow" );
+
+        quotient qr = divide( r, n );
+        uint64_t q = qr.quot;
+        if( mode == rounding::up && qr.rem != 0 ) ++q;
+        if( mode == rounding::nearest && qr.rem >= r.den - qr.rem ) ++q;
+        eosio::check( q <= static_cast<uint64_t>( eosio::asset::max_amount ), "price conversion overflow" );
+        return static_cast<int64_t>( q );
+    }
+
+    // step of a tiered curve active at time t, steps sorted by their start
+    // member and the last one stays active once the curve is past its end
+    template<typename It>
+    It at_time( It first, It last, uint32_t t )
+    {
+        auto next = std::upper_bound( first, last, t, []( uint32_t time, const auto& step ) {
+            return time < step.start;
+        });
+        eosio::check( next != first, "price curve has not started" );
+        return std::prev( next );
+    }
+
+} /// namespace pricing
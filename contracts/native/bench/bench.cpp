@@ -0,0 +1,246 @@
+#include "../probe.hpp"
+#include "../tests/fixture.hpp"
+
+#include "../../common/buyer_shard.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Cost of single actions on the instrumented contracts. Every scenario sets
+// up a fresh chain, then one measured transaction runs and is reported as a
+// json line: the probe counters of every action it applied, the ram each
+// account gained or freed, and the wall time. Counters and ram are
+// deterministic, --check fails when any of them grows past its limit in the
+// baseline file, --write stores the current numbers as the new baseline.
+
+using namespace fixture;
+
+namespace {
+
+   struct scenario {
+      const char* name;
+      void (*setup)();
+      void (*run)();
+   };
+
+   const name alice( "alice" );
+   const name bob( "bob" );
+   const name carol( "carol" );
+
+   void holders()
+   {
+      accounts( { "alice", "bob", "carol" } );
+      create_mpt();
+      send_mpt( token, alice, mpt( 1'000'0000 ) );
+      chain().push( token, name( "claim" ), { alice }, alice, mpt_symbol );
+      send_mpt( alice, bob, mpt( 1'0000 ) );
+   }
+
+   // crowdsale with alice holding bought tokens
+   void bought()
+   {
+      open_sale();
+      accounts( { "bob" } );
+      chain().time = sale_start + 1;
+      buy( alice, eos( 10'0000 ) );
+   }
+
+   // order of alice waiting in the queue
+   void queued()
+   {
+      open_sale();
+      chain().push( sale, name( "setqueue" ), { sale }, token, true );
+      chain().time = sale_start + 1;
+      buy( alice, eos( 10'0000 ) );
+   }
+
+   void team_member()
+   {
+      create_mpt();
+      accounts( { "carol" } );
+      send_mpt( token, team, mpt( 100'0000 ) );
+      chain().push( team, name( "addtoken" ), { team }, token, mpt_symbol, uint32_t( 100 ), uint32_t( 50 ) );
+      chain().push( team, name( "addmember" ), { team }, carol, token, mpt( 40'0000 ) );
+      chain().time = 151;
+   }
+
+   const scenario scenarios[] = {
+      { "transfer", holders, [] {
+         send_mpt( alice, bob, mpt( 1'0000 ) );
+      } },
+      { "transfer_new_row", holders, [] {
+         send_mpt( alice, carol, mpt( 1'0000 ) );
+      } },
+      { "claim", [] {
+         accounts( { "alice" } );
+         create_mpt();
+         send_mpt( token, alice, mpt( 1'0000 ) );
+      }, [] {
+         chain().push( token, name( "claim" ), { alice }, alice, mpt_symbol );
+      } },
+      { "crowdsale_buy", [] {
+         open_sale();
+         accounts( { "alice" } );
+         give_eos( alice, eos( 10'0000 ) );
+         chain().time = sale_start + 1;
+      }, [] {
+         send_eos( alice, sale, eos( 10'0000 ) );
+      } },
+      { "crowdsale_token_transfer", bought, [] {
+         send_mpt( alice, bob, mpt( 10'0000 ) );
+      } },
+      { "buyback", [] {
+         bought();
+         chain().time = buyback_start + 1;
+      }, [] {
+         send_mpt( alice, sale, mpt( 10'0000 ) );
+      } },
+      { "fillorders", queued, [] {
+         chain().push( sale, name( "fillorders" ), { alice }, metpack::buyer_shard( alice ), uint32_t( 10 ) );
+      } },
+      { "claimorder", [] {
+         queued();
+         chain().push( sale, name( "fillorders" ), { alice }, metpack::buyer_shard( alice ), uint32_t( 10 ) );
+      }, [] {
+         chain().push( sale, name( "claimorder" ), { alice }, alice );
+      } },
+      { "team_withdraw", team_member, [] {
+         chain().push( team, name( "withdraw" ), { carol }, carol, token, mpt_symbol );
+      } },
+   };
+
+   // one measured number, "<receiver>:<action>" and counter, or "ram" and account
+   using metric_key = std::tuple<std::string, std::string, std::string>;
+
+   struct result {
+      std::string                      json;
+      std::map<metric_key, int64_t>    metrics;
+   };
+
+   std::map<name, int64_t> ram_by_account()
+   {
+      std::map<name, int64_t> ram;
+      for( uint64_t a : chain().accounts ) ram[name( a )] = chain().ram_usage( name( a ) );
+      return ram;
+   }
+
+   result measure( const scenario& s )
+   {
+      native::deploy_contracts();
+      s.setup();
+      auto ram_before = ram_by_account();
+      auto start = std::chrono::steady_clock::now();
+      s.run();
+      auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+
+      result r;
+      std::ostringstream json;
+      json << "{\"scenario\":\"" << s.name << "\",\"wall_ns\":" << wall << ",\"actions\":[";
+      bool first = true;
+      for( const auto& rec : native::probe_records( chain().traces() ) )
+      {
+         json << ( first ? "" : "," ) << "{\"receiver\":\"" << rec.receiver.to_string() << "\",\"action\":\"" << rec.action << "\"";
+         for( const auto& c : rec.counters )
+         {
+            json << ",\"" << c.first << "\":" << c.second;
+            r.metrics[metric_key( s.name, rec.receiver.to_string() + ":" + rec.action, c.first )] += c.second;
+         }
+         json << "}";
+         first = false;
+      }
+      json << "],\"ram\":{";
+      first = true;
+      for( const auto& [account, bytes] : ram_by_account() )
+      {
+         int64_t delta = bytes - ram_before[account];
+         if( delta == 0 ) continue;
+         json << ( first ? "" : "," ) << "\"" << account.to_string() << "\":" << delta;
+         r.metrics[metric_key( s.name, "ram", account.to_string() )] = delta;
+         first = false;
+      }
+      json << "}}";
+      r.json = json.str();
+      return r;
+   }
+
+   // lines of "<scenario> <receiver>:<action>|ram <counter>|<account> <limit>"
+   std::map<metric_key, int64_t> read_baseline( const char* path )
+   {
+      std::map<metric_key, int64_t> limits;
+      std::ifstream in( path );
+      if( !in ) throw std::runtime_error( std::string( "cannot read baseline " ) + path );
+      std::string line;
+      while( std::getline( in, line ) )
+      {
+         if( line.empty() || line[0] == '#' ) continue;
+         std::istringstream fields( line );
+         std::string scenario_name, what, counter;
+         int64_t limit;
+         if( !( fields >> scenario_name >> what >> counter >> limit ) ) throw std::runtime_error( "bad baseline line: " + line );
+         limits[metric_key( scenario_name, what, counter )] = limit;
+      }
+      return limits;
+   }
+
+}
+
+int main( int argc, char** argv )
+{
+   const char* check = nullptr;
+   const char* write = nullptr;
+   for( int i = 1; i + 1 < argc; i += 2 )
+   {
+      if( !std::strcmp( argv[i], "--check" ) ) check = argv[i + 1];
+      else if( !std::strcmp( argv[i], "--write" ) ) write = argv[i + 1];
+   }
+
+   std::map<metric_key, int64_t> measured;
+   for( const auto& s : scenarios )
+   {
+      auto r = measure( s );
+      std::cout << r.json << "\n";
+      measured.insert( r.metrics.begin(), r.metrics.end() );
+   }
+
+   if( write )
+   {
+      std::ofstream out( write );
+      out << "# limits of metpack_bench --check, regenerate with --write\n";
+      for( const auto& [key, value] : measured )
+      {
+         out << std::get<0>( key ) << " " << std::get<1>( key ) << " " << std::get<2>( key ) << " " << value << "\n";
+      }
+   }
+
+   int over = 0;
+   if( check )
+   {
+      auto limits = read_baseline( check );
+      for( const auto& [key, limit] : limits )
+      {
+         auto m = measured.find( key );
+         int64_t value = m == measured.end() ? 0 : m->second;
+         if( value <= limit ) continue;
+         ++over;
+         std::cerr << "over baseline: " << std::get<0>( key ) << " " << std::get<1>( key ) << " " << std::get<2>( key )
+                   << " " << value << " > " << limit << "\n";
+      }
+      // a counter the baseline does not know yet has no limit to keep
+      for( const auto& [key, value] : measured )
+      {
+         if( value > 0 && !limits.count( key ) )
+         {
+            ++over;
+            std::cerr << "not in baseline: " << std::get<0>( key ) << " " << std::get<1>( key ) << " " << std::get<2>( key ) << " " << value << "\n";
+         }
+      }
+   }
+   return over == 0 ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+#include "chain.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+   void metpacktoken_apply( uint64_t receiver, uint64_t code, uint64_t action );
+   void mptcrowdsale_apply( uint64_t receiver, uint64_t code, uint64_t action );
+   void metpackteam_apply( uint64_t receiver, uint64_t code, uint64_t action );
+   void eosio_token_apply( uint64_t receiver, uint64_t code, uint64_t action );
+}
+
+namespace native {
+
+   // the chain limits inline actions sent from inline actions to this depth
+   static constexpr uint32_t max_inline_depth = 4;
+
+   chain& chain::get()
+   {
+      static chain c;
+      return c;
+   }
+
+   void chain::reset()
+   {
+      tables.clear();
+      accounts.clear();
+      _code.clear();
+      _grants.clear();
+      _traces.clear();
+      time = 0;
+   }
+
+   void chain::create_account( name account )
+   {
+      accounts.insert( account.value );
+   }
+
+   void chain::set_code( name account, apply_fn apply )
+   {
+      create_account( account );
+      _code[account.value] = apply;
+   }
+
+   void chain::grant_code( name actor, name contract )
+   {
+      _grants.emplace( actor.value, contract.value );
+   }
+
+   void chain::push_action( name account, name act, const std::vector<eosio::permission_level>& auth, std::vector<char> data )
+   {
+      eosio::action a;
+      a.account = account;
+      a.name = act;
+      a.authorization = auth;
+      a.data = std::move( data );
+
+      auto saved = tables;
+      _traces.clear();
+      try {
+         for( const auto& p : auth )
+         {
+            if( !accounts.count( p.actor.value ) ) fail( "transaction declares authority of unknown account " + p.actor.to_string() );
+         }
+         execute( a, name(), 0 );
+      } catch( ... ) {
+         tables = std::move( saved );
+         current = nullptr;
+         throw;
+      }
+   }
+
+   void chain::execute( const eosio::action& act, name sender, uint32_t depth )
+   {
+      if( depth > max_inline_depth ) fail( "max inline action depth exceeded" );
+      if( !accounts.count( act.account.value ) ) fail( "action sent to unknown account " + act.account.to_string() );
+
+      // an inline action may only carry the sender's own authority or one granted to its code
+      if( sender.value != 0 )
+      {
+         for( const auto& p : act.authorization )
+         {
+            if( p.actor != sender && !_grants.count( { p.actor.value, sender.value } ) )
+               fail( "inline action from " + sender.to_string() + " lacks the authority of " + p.actor.to_string() );
+         }
+      }
+
+      std::vector<permission> auth;
+      for( const auto& p : act.authorization ) auth.push_back( permission{ p.actor.value, p.permission.value } );
+
+      context ctx{ act.account, act.account, act.name, &act.data, &auth, {}, {}, {} };
+      apply( ctx );
+
+      // notified accounts run in the order they were added, each once
+      std::vector<name> done{ act.account };
+      for( size_t i = 0; i < ctx.notified.size(); ++i )
+      {
+         name r = ctx.notified[i];
+         if( std::find( done.begin(), done.end(), r ) != done.end() ) continue;
+         done.push_back( r );
+
+         context note{ r, act.account, act.name, &act.data, &auth, {}, {}, {} };
+         apply( note );
+         for( auto& sent : note.inlines ) ctx.inlines.push_back( std::move( sent ) );
+         // accounts notified from a notification are notified as well
+         for( name n : note.notified ) ctx.notified.push_back( n );
+      }
+
+      for( const auto& sent : ctx.inlines ) execute( sent.second, sent.first, depth + 1 );
+   }
+
+   void chain::apply( context& ctx )
+   {
+      context* outer = current;
+      current = &ctx;
+      auto code = _code.find( ctx.receiver.value );
+      try {
+         if( code != _code.end() ) code->second( ctx.receiver.value, ctx.code.value, ctx.action.value );
+      } catch( ... ) {
+         _traces.push_back( action_trace{ ctx.receiver, ctx.code, ctx.action, ctx.console } );
+         current = outer;
+         throw;
+      }
+      _traces.push_back( action_trace{ ctx.receiver, ctx.code, ctx.action, ctx.console } );
+      current = outer;
+   }
+
+   size_t chain::ram_usage( name account )const
+   {
+      // the chain bills each row its packed size and a fixed overhead
+      static constexpr size_t row_overhead = 112;
+      size_t usage = 0;
+      for( const auto& t : tables )
+      {
+         for( const auto& row : t.second )
+         {
+            if( row.second.payer == account.value ) usage += row.second.data.size() + row_overhead;
+         }
+      }
+      return usage;
+   }
+
+   uint64_t chain::row_payer( name code, uint64_t scope, name table, uint64_t primary )const
+   {
+      auto t = tables.find( table_id{ code.value, scope, table.value } );
+      if( t == tables.end() ) return 0;
+      auto row = t->second.find( primary );
+      return row == t->second.end() ? 0 : row->second.payer;
+   }
+
+   chain& deploy_contracts()
+   {
+      chain& c = chain::get();
+      c.reset();
+      c.set_code( name( "metpacktoken" ), metpacktoken_apply );
+      c.set_code( name( "mptcrowdsale" ), mptcrowdsale_apply );
+      c.set_code( name( "metpackteam" ), metpackteam_apply );
+      c.set_code( name( "eosio.token" ), eosio_token_apply );
+      return c;
+   }
+
+   // host interface of the eosiolib headers
+
+   void fail( const std::string& msg )
+   {
+      throw assert_failure( msg );
+   }
+
+   void console( std::string_view text )
+   {
+      auto* ctx = chain::get().current;
+      if( ctx ) ctx->console.append( text.data(), text.size() );
+   }
+
+   uint32_t now()
+   {
+      return chain::get().time;
+   }
+
+   static chain::context& current( const char* what )
+   {
+      auto* ctx = chain::get().current;
+      if( !ctx ) fail( std::string( what ) + " called outside of an action" );
+      return *ctx;
+   }
+
+   uint32_t action_data_size()
+   {
+      return static_cast<uint32_t>( current( "action_data_size" ).data->size() );
+   }
+
+   void read_action_data( void* buffer, uint32_t size )
+   {
+      const auto& data = *current( "read_action_data" ).data;
+      std::memcpy( buffer, data.data(), std::min<size_t>( size, data.size() ) );
+   }
+
+   uint64_t current_receiver()
+   {
+      return current( "current_receiver" ).receiver.value;
+   }
+
+   bool has_auth( uint64_t account )
+   {
+      for( const auto& p : *current( "has_auth" ).auth )
+      {
+         if( p.actor == account ) return true;
+      }
+      return false;
+   }
+
+   void require_recipient( uint64_t account )
+   {
+      if( !is_account( account ) ) fail( "can not notify unknown account " + name( account ).to_string() );
+      current( "require_recipient" ).notified.push_back( name( account ) );
+   }
+
+   bool is_account( uint64_t account )
+   {
+      return chain::get().accounts.count( account ) != 0;
+   }
+
+   void send_inline( uint64_t account, uint64_t action, const std::vector<permission>& auth, std::vector<char> data )
+   {
+      auto& ctx = current( "send_inline" );
+      eosio::action a;
+      a.account = name( account );
+      a.name = name( action );
+      for( const auto& p : auth ) a.authorization.emplace_back( name( p.actor ), name( p.permission ) );
+      a.data = std::move( data );
+      ctx.inlines.emplace_back( ctx.receiver, std::move( a ) );
+   }
+
+   table_rows* db_table( uint64_t code, uint64_t scope, uint64_t table, bool create )
+   {
+      auto& tables = chain::get().tables;
+      table_id id{ code, scope, table };
+      if( create ) return &tables[id];
+      auto t = tables.find( id );
+      return t == tables.end() ? nullptr : &t->second;
+   }
+
+   void db_drop_if_empty( uint64_t code, uint64_t scope, uint64_t table )
+   {
+      auto& tables = chain::get().tables;
+      auto t = tables.find( table_id{ code, scope, table } );
+      if( t != tables.end() && t->second.empty() ) tables.erase( t );
+   }
+
+} /// namespace native
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "host.hpp"
+
+#include <eosiolib/action.hpp>
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/name.hpp>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Single threaded stand-in for the chain the contracts run on. Actions are
+// applied with the chain's ordering: the receiver, then every account it
+// notified, then the inline actions all of them sent, depth first. A failed
+// assert rolls the whole transaction back and is rethrown to the caller.
+namespace native {
+
+   using eosio::name;
+
+   using apply_fn = void (*)( uint64_t receiver, uint64_t code, uint64_t action );
+
+   // what one receiver did with one action
+   struct action_trace {
+      name        receiver;
+      name        code;
+      name        action;
+      std::string console;
+   };
+
+   struct table_id {
+      uint64_t code;
+      uint64_t scope;
+      uint64_t table;
+
+      friend bool operator<( const table_id& a, const table_id& b )
+      {
+         return std::tie( a.code, a.scope, a.table ) < std::tie( b.code, b.scope, b.table );
+      }
+
+      friend bool operator==( const table_id& a, const table_id& b )
+      {
+         return a.code == b.code && a.scope == b.scope && a.table == b.table;
+      }
+   };
+
+   class chain {
+      public:
+         static chain& get();
+
+         // clears accounts, code, tables and the clock
+         void reset();
+
+         void create_account( name account );
+         void set_code( name account, apply_fn apply );
+
+         // lets contract send inline actions with the authority of actor,
+         // like adding contract@eosio.code to the active permission of actor
+         void grant_code( name actor, name contract );
+
+         uint32_t time = 0;
+
+         // one transaction of one action, packs args as the action data
+         template<typename... Args>
+         void push( name account, name act, std::vector<name> actors, const Args&... args )
+         {
+            std::vector<eosio::permission_level> auth;
+            for( name a : actors ) auth.emplace_back( a, name( "active" ) );
+            push_action( account, act, auth, eosio::pack( std::make_tuple( args... ) ) );
+         }
+
+         void push_action( name account, name act, const std::vector<eosio::permission_level>& auth, std::vector<char> data );
+
+         // traces of the last transaction, also of one that failed
+         const std::vector<action_trace>& traces()const { return _traces; }
+
+         // bytes of table rows account pays for
+         size_t ram_usage( name account )const;
+
+         // payer of one row, zero when the row does not exist
+         uint64_t row_payer( name code, uint64_t scope, name table, uint64_t primary )const;
+
+         std::map<table_id, table_rows> tables;
+
+         // one receiver applying one action, read by the host interface
+         struct context {
+            name                               receiver;
+            name                               code;
+            name                               action;
+            const std::vector<char>*           data;
+            const std::vector<permission>*     auth;
+            std::vector<name>                  notified;
+            std::vector<std::pair<name, eosio::action>> inlines;   // sender and action
+            std::string                        console;
+         };
+
+         context* current = nullptr;
+         std::set<uint64_t> accounts;
+
+      private:
+         void execute( const eosio::action& act, name sender, uint32_t depth );
+         void apply( context& ctx );
+
+         std::map<uint64_t, apply_fn>             _code;
+         std::set<std::pair<uint64_t, uint64_t>>  _grants;
+         std::vector<action_trace>                _traces;
+   };
+
+   // receiver set up the way the contracts find each other on chain
+   chain& deploy_contracts();
+
+} /// namespace native
@@ -0,0 +1,93 @@
+#include <eosiolib/asset.hpp>
+#include <eosiolib/eosio.hpp>
+
+#include <string>
+
+using namespace eosio;
+
+// The system token the crowdsale is paid in, create, issue and transfer with
+// the notifications eosio.token sends, so a payment reaches the crowdsale
+// the way it does on chain
+class system_token : public contract {
+   public:
+      using contract::contract;
+
+      void create( name issuer, asset maximum_supply )
+      {
+         require_auth( _self );
+         check( maximum_supply.is_valid() && maximum_supply.amount > 0, "invalid supply" );
+         stats statstable( _self, maximum_supply.symbol.code().raw() );
+         check( statstable.find( maximum_supply.symbol.code().raw() ) == statstable.end(), "token with symbol already exists" );
+         statstable.emplace( _self, [&]( auto& s ) {
+            s.supply     = asset( 0, maximum_supply.symbol );
+            s.max_supply = maximum_supply;
+            s.issuer     = issuer;
+         });
+      }
+
+      void issue( name to, asset quantity, std::string memo )
+      {
+         stats statstable( _self, quantity.symbol.code().raw() );
+         const auto& st = statstable.get( quantity.symbol.code().raw(), "token with symbol does not exist" );
+         require_auth( st.issuer );
+         check( quantity.is_valid() && quantity.amount > 0, "must issue positive quantity" );
+         check( quantity.amount <= st.max_supply.amount - st.supply.amount, "quantity exceeds available supply" );
+         statstable.modify( st, same_payer, [&]( auto& s ) { s.supply += quantity; });
+         add_balance( to, quantity, st.issuer );
+      }
+
+      void transfer( name from, name to, asset quantity, std::string memo )
+      {
+         check( from != to, "cannot transfer to self" );
+         require_auth( from );
+         check( is_account( to ), "to account does not exist" );
+         require_recipient( from );
+         require_recipient( to );
+         check( quantity.is_valid() && quantity.amount > 0, "must transfer positive quantity" );
+         check( memo.size() <= 256, "memo has more than 256 bytes" );
+         sub_balance( from, quantity );
+         add_balance( to, quantity, from );
+      }
+
+   private:
+      struct account {
+         asset balance;
+
+         uint64_t primary_key()const { return balance.symbol.code().raw(); }
+      };
+
+      struct currency_stats {
+         asset supply;
+         asset max_supply;
+         name  issuer;
+
+         uint64_t primary_key()const { return supply.symbol.code().raw(); }
+      };
+
+      typedef multi_index< "accounts"_n, account > accounts;
+      typedef multi_index< "stat"_n, currency_stats > stats;
+
+      void sub_balance( name owner, asset value )
+      {
+         accounts from_acnts( _self, owner.value );
+         const auto& from = from_acnts.get( value.symbol.code().raw(), "no balance object found" );
+         check( from.balance.amount >= value.amount, "overdrawn balance" );
+         from_acnts.modify( from, owner, [&]( auto& a ) { a.balance -= value; });
+      }
+
+      void add_balance( name owner, asset value, name ram_payer )
+      {
+         accounts to_acnts( _self, owner.value );
+         auto to = to_acnts.find( value.symbol.code().raw() );
+         if( to == to_acnts.end() ) to_acnts.emplace( ram_payer, [&]( auto& a ) { a.balance = value; });
+         else to_acnts.modify( to, same_payer, [&]( auto& a ) { a.balance += value; });
+      }
+};
+
+extern "C" void eosio_token_apply( uint64_t receiver, uint64_t code, uint64_t action )
+{
+   if( code != receiver ) return;
+   switch( action ) {
+      EOSIO_DISPATCH_HELPER( system_token, (create)(issue)(transfer) )
+   }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "datastream.hpp"
+#include "name.hpp"
+#include "../host.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace eosio {
+
+   struct permission_level {
+      permission_level( name a, name p ) : actor( a ), permission( p ) {}
+      permission_level() {}
+
+      name actor;
+      name permission;
+
+      friend bool operator==( const permission_level& a, const permission_level& b )
+      {
+         return a.actor == b.actor && a.permission == b.permission;
+      }
+   };
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const permission_level& p ) { return ds << p.actor << p.permission; }
+
+   template<typename Stream>
+   Stream& operator>>( Stream& ds, permission_level& p ) { return ds >> p.actor >> p.permission; }
+
+   inline void require_auth( name n )
+   {
+      if( !native::has_auth( n.value ) ) native::fail( "missing authority of " + n.to_string() );
+   }
+
+   inline bool has_auth( name n )           { return native::has_auth( n.value ); }
+   inline void require_recipient( name n )  { native::require_recipient( n.value ); }
+   inline bool is_account( name n )         { return native::is_account( n.value ); }
+
+   template<typename... Names>
+   void require_recipient( name n, Names... more )
+   {
+      require_recipient( n );
+      require_recipient( more... );
+   }
+
+   // inline action, send hands it to the host chain which runs it after the
+   // current action and its notifications, like the chain does
+   struct action {
+      eosio::name                   account;
+      eosio::name                   name;
+      std::vector<permission_level> authorization;
+      std::vector<char>             data;
+
+      action() {}
+
+      template<typename T>
+      action( const permission_level& auth, struct name a, struct name n, T&& value )
+         : account( a ), name( n ), authorization( 1, auth ), data( pack( std::forward<T>( value ) ) ) {}
+
+      template<typename T>
+      action( std::vector<permission_level> auths, struct name a, struct name n, T&& value )
+         : account( a ), name( n ), authorization( std::move( auths ) ), data( pack( std::forward<T>( value ) ) ) {}
+
+      void send()const
+      {
+         std::vector<native::permission> auth;
+         for( const auto& p : authorization ) auth.push_back( native::permission{ p.actor.value, p.permission.value } );
+         native::send_inline( account.value, name.value, auth, data );
+      }
+   };
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const action& a ) { return ds << a.account << a.name << a.authorization << a.data; }
+
+} /// namespace eosio
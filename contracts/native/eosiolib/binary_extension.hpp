@@ -0,0 +1,51 @@
+#pragma once
+
+#include "system.hpp"
+
+#include <optional>
+#include <utility>
+
+namespace eosio {
+
+   // trailing row field that older rows do not have, written only when set
+   template<typename T>
+   class binary_extension {
+      public:
+         using value_type = T;
+
+         constexpr binary_extension() {}
+         constexpr binary_extension( const T& ext ) : _value( ext ) {}
+         constexpr binary_extension( T&& ext ) : _value( std::move( ext ) ) {}
+
+         constexpr bool has_value()const { return _value.has_value(); }
+
+         T& value()
+         {
+            eosio::check( _value.has_value(), "cannot get value of empty binary_extension" );
+            return *_value;
+         }
+
+         const T& value()const
+         {
+            eosio::check( _value.has_value(), "cannot get value of empty binary_extension" );
+            return *_value;
+         }
+
+         template<typename U = T>
+         T value_or( U&& def = U() )const { return _value.has_value() ? *_value : static_cast<T>( std::forward<U>( def ) ); }
+
+         template<typename... Args>
+         T& emplace( Args&&... args ) { return _value.emplace( std::forward<Args>( args )... ); }
+
+         void reset() { _value.reset(); }
+
+         T&       operator*()        { return value(); }
+         const T& operator*()const   { return value(); }
+         T*       operator->()       { return &value(); }
+         const T* operator->()const  { return &value(); }
+
+      private:
+         std::optional<T> _value;
+   };
+
+} /// namespace eosio
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "asset.hpp"
+#include "binary_extension.hpp"
+#include "crypto.hpp"
+#include "name.hpp"
+#include "symbol.hpp"
+#include "system.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace eosio {
+
+   // cdt serializes table and action structs by reflecting their fields, the
+   // host does the same for aggregates with structured bindings
+   namespace reflect {
+
+      struct any_field {
+         template<typename T>
+         constexpr operator T()const;
+      };
+
+      template<typename T, typename Seq, typename = void>
+      struct init_with : std::false_type {};
+
+      template<typename T, size_t... I>
+      struct init_with<T, std::index_sequence<I...>, std::void_t<decltype( T{ ( (void)I, any_field{} )... } )>> : std::true_type {};
+
+      template<typename T, size_t N = 20>
+      constexpr size_t field_count()
+      {
+         if constexpr( N == 0 ) return 0;
+         else if constexpr( init_with<T, std::make_index_sequence<N>>::value ) return N;
+         else return field_count<T, N - 1>();
+      }
+
+      template<typename T>
+      constexpr bool is_reflected = std::is_class_v<T> && std::is_aggregate_v<T>;
+
+      template<typename T, typename F>
+      void for_each_field( T& t, F&& f )
+      {
+         constexpr size_t n = field_count<std::remove_const_t<T>>();
+         static_assert( n > 0 && n <= 20, "cannot reflect this struct" );
+         if constexpr( false ) {}
+         else if constexpr( n == 1 ) { auto& [ f0 ] = t; f( f0 ); }
+         else if constexpr( n == 2 ) { auto& [ f0, f1 ] = t; f( f0 ); f( f1 ); }
+         else if constexpr( n == 3 ) { auto& [ f0, f1, f2 ] = t; f( f0 ); f( f1 ); f( f2 ); }
+         else if constexpr( n == 4 ) { auto& [ f0, f1, f2, f3 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); }
+         else if constexpr( n == 5 ) { auto& [ f0, f1, f2, f3, f4 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); }
+         else if constexpr( n == 6 ) { auto& [ f0, f1, f2, f3, f4, f5 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); }
+         else if constexpr( n == 7 ) { auto& [ f0, f1, f2, f3, f4, f5, f6 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); }
+         else if constexpr( n == 8 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); }
+         else if constexpr( n == 9 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); }
+         else if constexpr( n == 10 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); }
+         else if constexpr( n == 11 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); }
+         else if constexpr( n == 12 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); }
+         else if constexpr( n == 13 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); }
+         else if constexpr( n == 14 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); f( f13 ); }
+         else if constexpr( n == 15 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); f( f13 ); f( f14 ); }
+         else if constexpr( n == 16 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); f( f13 ); f( f14 ); f( f15 ); }
+         else if constexpr( n == 17 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15, f16 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); f( f13 ); f( f14 ); f( f15 ); f( f16 ); }
+         else if constexpr( n == 18 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15, f16, f17 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); f( f13 ); f( f14 ); f( f15 ); f( f16 ); f( f17 ); }
+         else if constexpr( n == 19 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15, f16, f17, f18 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); f( f13 ); f( f14 ); f( f15 ); f( f16 ); f( f17 ); f( f18 ); }
+         else if constexpr( n == 20 ) { auto& [ f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15, f16, f17, f18, f19 ] = t; f( f0 ); f( f1 ); f( f2 ); f( f3 ); f( f4 ); f( f5 ); f( f6 ); f( f7 ); f( f8 ); f( f9 ); f( f10 ); f( f11 ); f( f12 ); f( f13 ); f( f14 ); f( f15 ); f( f16 ); f( f17 ); f( f18 ); f( f19 ); }
+      }
+
+   } /// namespace reflect
+
+   template<typename T>
+   class datastream {
+      public:
+         datastream( T start, size_t s ) : _start( start ), _pos( start ), _end( start + s ) {}
+
+         void skip( size_t s ) { _pos += s; }
+
+         bool read( char* d, size_t s )
+         {
+            eosio::check( size_t( _end - _pos ) >= s, "read" );
+            std::memcpy( d, _pos, s );
+            _pos += s;
+            return true;
+         }
+
+         bool write( const char* d, size_t s )
+         {
+            eosio::check( _end - _pos >= int32_t( s ), "write" );
+            std::memcpy( (void*)_pos, d, s );
+            _pos += s;
+            return true;
+         }
+
+         T       pos()const       { return _pos; }
+         bool    valid()const     { return _pos <= _end && _pos >= _start; }
+         size_t  tellp()const     { return size_t( _pos - _start ); }
+         size_t  remaining()const { return _end - _pos; }
+
+      private:
+         T _start;
+         T _pos;
+         T _end;
+   };
+
+   // counts the bytes a value packs to
+   template<>
+   class datastream<size_t> {
+      public:
+         datastream( size_t init_size = 0 ) : _size( init_size ) {}
+
+         bool   skip( size_t s )                { _size += s; return true; }
+         bool   write( const char*, size_t s )  { _size += s; return true; }
+         size_t tellp()const                    { return _size; }
+         size_t remaining()const                { return 0; }
+
+      private:
+         size_t _size;
+   };
+
+   template<typename Stream>
+   void write_varuint32( Stream& ds, uint32_t v )
+   {
+      do {
+         uint8_t b = uint8_t( v ) & 0x7f;
+         v >>= 7;
+         b |= ( ( v > 0 ) << 7 );
+         ds.write( (const char*)&b, 1 );
+      } while( v );
+   }
+
+   template<typename Stream>
+   uint32_t read_varuint32( Stream& ds )
+   {
+      uint64_t v = 0;
+      uint8_t b = 0;
+      uint8_t by = 0;
+      do {
+         ds.read( (char*)&b, 1 );
+         v |= uint32_t( uint8_t( b ) & 0x7f ) << by;
+         by += 7;
+      } while( uint8_t( b ) & 0x80 );
+      return static_cast<uint32_t>( v );
+   }
+
+   template<typename Stream, typename T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>, int> = 0>
+   Stream& operator<<( Stream& ds, const T& v ) { ds.write( (const char*)&v, sizeof(T) ); return ds; }
+
+   template<typename Stream, typename T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>, int> = 0>
+   Stream& operator>>( Stream& ds, T& v ) { ds.read( (char*)&v, sizeof(T) ); return ds; }
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const name& n ) { return ds << n.value; }
+
+   template<typename Stream>
+   Stream& operator>>( Stream& ds, name& n ) { return ds >> n.value; }
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const symbol_code& s ) { return ds << s.raw(); }
+
+   template<typename Stream>
+   Stream& operator>>( Stream& ds, symbol_code& s ) { uint64_t raw; ds >> raw; s = symbol_code( raw ); return ds; }
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const symbol& s ) { return ds << s.raw(); }
+
+   template<typename Stream>
+   Stream& operator>>( Stream& ds, symbol& s ) { uint64_t raw; ds >> raw; s = symbol( raw ); return ds; }
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const asset& a ) { return ds << a.amount << a.symbol; }
+
+   template<typename Stream>
+   Stream& operator>>( Stream& ds, asset& a ) { return ds >> a.amount >> a.symbol; }
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const checksum256& c ) { ds.write( (const char*)c.data(), 32 ); return ds; }
+
+   template<typename Stream>
+   Stream& operator>>( Stream& ds, checksum256& c ) { ds.read( (char*)c.data(), 32 ); return ds; }
+
+   template<typename Stream>
+   Stream& operator<<( Stream& ds, const std::string& s )
+   {
+      write_varuint32( ds, uint32_t( s.size() ) );
+      if( !s.empty() ) ds.write( s.data(), s.size() );
+      return ds;
+   }
+
+   template<typename Stream>
+   Stream& operator>>( Stream& ds, std::string& s )
+   {
+      s.resize( read_varuint32( ds ) );
+      if( !s.empty() ) ds.read( s.data(), s.size() );
+      return ds;
+   }
+
+   template<typename Stream, typename T>
+   Stream& operator<<( Stream& ds, const std::vector<T>& v )
+   {
+      write_varuint32( ds, uint32_t( v.size() ) );
+      for( const auto& i : v ) ds << i;
+      return ds;
+   }
+
+   template<typename Stream, typename T>
+   Stream& operator>>( Stream& ds, std::vector<T>& v )
+   {
+      v.resize( read_varuint32( ds ) );
+      for( auto& i : v ) ds >> i;
+      return ds;
+   }
+
+   template<typename Stream, typename A, typename B>
+   Stream& operator<<( Stream& ds, const std::pair<A, B>& p ) { return ds << p.first << p.second; }
+
+   template<typename Stream, typename A, typename B>
+   Stream& operator>>( Stream& ds, std::pair<A, B>& p ) { return ds >> p.first >> p.second; }
+
+   template<typename Stream, typename... Ts>
+   Stream& operator<<( Stream& ds, const std::tuple<Ts...>& t )
+   {
+      std::apply( [&]( const auto&... e ) { ( ( ds << e ), ... ); }, t );
+      return ds;
+   }
+
+   template<typename Stream, typename... Ts>
+   Stream& operator>>( Stream& ds, std::tuple<Ts...>& t )
+   {
+      std::apply( [&]( auto&... e ) { ( ( ds >> e ), ... ); }, t );
+      return ds;
+   }
+
+   // an extension is only written when set and only read when data is left
+   template<typename Stream, typename T>
+   Stream& operator<<( Stream& ds, const binary_extension<T>& e )
+   {
+      if( e.has_value() ) ds << e.value();
+      return ds;
+   }
+
+   template<typename Stream, typename T>
+   Stream& operator>>( Stream& ds, binary_extension<T>& e )
+   {
+      if( ds.remaining() )
+      {
+         T v;
+         ds >> v;
+         e.emplace( std::move( v ) );
+      }
+      return ds;
+   }
+
+   template<typename Stream, typename T, std::enable_if_t<reflect::is_reflected<T>, int> = 0>
+   Stream& operator<<( Stream& ds, const T& v )
+   {
+      reflect::for_each_field( v, [&]( const auto& f ) { ds << f; } );
+      return ds;
+   }
+
+   template<typename Stream, typename T, std::enable_if_t<reflect::is_reflected<T>, int> = 0>
+   Stream& operator>>( Stream& ds, T& v )
+   {
+      reflect::for_each_field( v, [&]( auto& f ) { ds >> f; } );
+      return ds;
+   }
+
+   template<typename T>
+   size_t pack_size( const T& value )
+   {
+      datastream<size_t> ps;
+      ps << value;
+      return ps.tellp();
+   }
+
+   template<typename T>
+   std::vector<char> pack( const T& value )
+   {
+      std::vector<char> result( pack_size( value ) );
+      datastream<char*> ds( result.data(), result.size() );
+      ds << value;
+      return result;
+   }
+
+   template<typename T>
+   T unpack( const char* buffer, size_t len )
+   {
+      T result;
+      datastream<const char*> ds( buffer, len );
+      ds >> result;
+      return result;
+   }
+
+   template<typename T>
+   T unpack( const std::vector<char>& bytes )
+   {
+      return unpack<T>( bytes.data(), bytes.size() );
+   }
+
+} /// namespace eosio
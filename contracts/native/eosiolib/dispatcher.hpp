@@ -0,0 +1,41 @@
+#pragma once
+
+#include "action.hpp"
+#include "datastream.hpp"
+#include "name.hpp"
+#include "system.hpp"
+
+#include <boost/preprocessor/seq/for_each.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace eosio {
+
+   // unpacks the action data into the parameters of the member and calls it
+   template<typename T, typename... Args>
+   bool execute_action( name self, name code, void (T::*func)( Args... ) )
+   {
+      std::vector<char> buffer( action_data_size() );
+      if( !buffer.empty() ) read_action_data( buffer.data(), buffer.size() );
+
+      std::tuple<std::decay_t<Args>...> args;
+      datastream<const char*> ds( buffer.data(), buffer.size() );
+      ds >> args;
+
+      T inst( self, code, ds );
+      std::apply( [&]( auto&... a ) { ( inst.*func )( a... ); }, args );
+      return true;
+   }
+
+} /// namespace eosio
+
+#define EOSIO_DISPATCH_INTERNAL( r, OP, elem ) \
+   case eosio::name( BOOST_PP_STRINGIZE( elem ) ).value: \
+      eosio::execute_action( eosio::name( receiver ), eosio::name( code ), &OP::elem ); \
+      break;
+
+#define EOSIO_DISPATCH_HELPER( TYPE, MEMBERS ) \
+   BOOST_PP_SEQ_FOR_EACH( EOSIO_DISPATCH_INTERNAL, TYPE, MEMBERS )
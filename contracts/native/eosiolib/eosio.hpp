@@ -0,0 +1,9 @@
+#pragma once
+
+#include "action.hpp"
+#include "contract.hpp"
+#include "dispatcher.hpp"
+#include "multi_index.hpp"
+#include "name.hpp"
+#include "print.hpp"
+#include "system.hpp"
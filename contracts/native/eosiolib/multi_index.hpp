@@ -0,0 +1,421 @@
+#pragma once
+
+#include "datastream.hpp"
+#include "name.hpp"
+#include "system.hpp"
+#include "../host.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Host multi_index over the rows of native::db_table. Rows are stored packed
+// like on chain, so a struct reading another contract's table with a shorter
+// layout sees the leading fields only. Each instance caches the objects it has
+// loaded and hands out references into that cache like the cdt one does,
+// objects cached by one instance do not see writes made through another.
+namespace eosio {
+
+   constexpr name same_payer{};
+
+   template<name::raw IndexName, typename Extractor>
+   struct indexed_by {
+      static constexpr name::raw index_name = IndexName;
+      typedef Extractor secondary_extractor_type;
+   };
+
+   template<class Class, typename Type, Type (Class::*PtrToMemberFunction)()const>
+   struct const_mem_fun {
+      typedef typename std::remove_reference<Type>::type result_type;
+
+      Type operator()( const Class& x )const { return ( x.*PtrToMemberFunction )(); }
+   };
+
+   template<name::raw TableName, typename T, typename... Indices>
+   class multi_index {
+      private:
+         struct item {
+            T        value;
+            uint64_t primary = 0;
+         };
+
+         name     _code;
+         uint64_t _scope;
+
+         mutable std::map<uint64_t, std::unique_ptr<item>> _items;
+         // erased objects stay allocated so references to them do not dangle
+         mutable std::vector<std::unique_ptr<item>>         _erased;
+
+         native::table_rows* rows( bool create = false )const
+         {
+            return native::db_table( _code.value, _scope, static_cast<uint64_t>( TableName ), create );
+         }
+
+         const item* load( uint64_t primary )const
+         {
+            auto cached = _items.find( primary );
+            if( cached != _items.end() ) return cached->second.get();
+            auto* r = rows();
+            if( !r ) return nullptr;
+            auto row = r->find( primary );
+            if( row == r->end() ) return nullptr;
+            auto i = std::make_unique<item>();
+            i->value = unpack<T>( row->second.data );
+            i->primary = primary;
+            return ( _items[primary] = std::move( i ) ).get();
+         }
+
+         template<typename Pick>
+         const item* load_at( Pick&& pick )const
+         {
+            auto* r = rows();
+            if( !r ) return nullptr;
+            auto row = pick( *r );
+            return row == r->end() ? nullptr : load( row->first );
+         }
+
+         item& cached( const T& obj, const char* error_msg )const
+         {
+            auto i = _items.find( obj.primary_key() );
+            eosio::check( i != _items.end() && &i->second->value == &obj, error_msg );
+            return *i->second;
+         }
+
+         template<typename Extractor>
+         using key_of = std::decay_t<decltype( Extractor()( std::declval<const T&>() ) )>;
+
+         // secondary keys of all rows with their primary keys, sorted like the chain orders them
+         template<typename Extractor>
+         std::vector<std::pair<key_of<Extractor>, uint64_t>> secondary_order()const
+         {
+            std::vector<std::pair<key_of<Extractor>, uint64_t>> keys;
+            if( auto* r = rows() )
+            {
+               for( const auto& row : *r )
+               {
+                  auto i = _items.find( row.first );
+                  if( i != _items.end() ) keys.emplace_back( Extractor()( i->second->value ), row.first );
+                  else keys.emplace_back( Extractor()( unpack<T>( row.second.data ) ), row.first );
+               }
+            }
+            std::sort( keys.begin(), keys.end() );
+            return keys;
+         }
+
+         template<name::raw IndexName, typename First, typename... Rest>
+         static auto find_index()
+         {
+            if constexpr( First::index_name == IndexName ) return First();
+            else
+            {
+               static_assert( sizeof...(Rest) > 0, "name not found in indices" );
+               return find_index<IndexName, Rest...>();
+            }
+         }
+
+      public:
+         class const_iterator {
+            public:
+               using iterator_category = std::bidirectional_iterator_tag;
+               using value_type        = const T;
+               using difference_type   = std::ptrdiff_t;
+               using pointer           = const T*;
+               using reference         = const T&;
+
+               const_iterator() {}
+
+               const T& operator*()const
+               {
+                  eosio::check( _item != nullptr, "cannot dereference end iterator" );
+                  return _item->value;
+               }
+               const T* operator->()const { return &**this; }
+
+               const_iterator operator++( int ) { const_iterator result( *this ); ++( *this ); return result; }
+               const_iterator operator--( int ) { const_iterator result( *this ); --( *this ); return result; }
+
+               const_iterator& operator++()
+               {
+                  eosio::check( _item != nullptr, "cannot increment end iterator" );
+                  uint64_t primary = _item->primary;
+                  _item = _multidx->load_at( [&]( auto& r ) { return r.upper_bound( primary ); } );
+                  return *this;
+               }
+
+               const_iterator& operator--()
+               {
+                  if( _item == nullptr )
+                  {
+                     _item = _multidx->load_at( []( auto& r ) { return r.empty() ? r.end() : std::prev( r.end() ); } );
+                  }
+                  else
+                  {
+                     uint64_t primary = _item->primary;
+                     _item = _multidx->load_at( [&]( auto& r ) {
+                        auto it = r.lower_bound( primary );
+                        return it == r.begin() ? r.end() : std::prev( it );
+                     });
+                  }
+                  eosio::check( _item != nullptr, "cannot decrement iterator at beginning of table" );
+                  return *this;
+               }
+
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._item == b._item; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._item != b._item; }
+
+            private:
+               friend class multi_index;
+
+               const_iterator( const multi_index* mi, const item* i ) : _multidx( mi ), _item( i ) {}
+
+               const multi_index* _multidx = nullptr;
+               const item*        _item = nullptr;
+         };
+
+         // secondary index, ordered by its key and then by primary key
+         template<name::raw IndexName, typename Extractor>
+         class index {
+            public:
+               using secondary_key_type = key_of<Extractor>;
+
+               class const_iterator {
+                  public:
+                     using iterator_category = std::bidirectional_iterator_tag;
+                     using value_type        = const T;
+                     using difference_type   = std::ptrdiff_t;
+                     using pointer           = const T*;
+                     using reference         = const T&;
+
+                     const_iterator() {}
+
+                     const T& operator*()const
+                     {
+                        eosio::check( _item != nullptr, "cannot dereference end iterator" );
+                        return _item->value;
+                     }
+                     const T* operator->()const { return &**this; }
+
+                     const_iterator operator++( int ) { const_iterator result( *this ); ++( *this ); return result; }
+
+                     const_iterator& operator++()
+                     {
+                        eosio::check( _item != nullptr, "cannot increment end iterator" );
+                        auto keys = _mi->template secondary_order<Extractor>();
+                        auto at = std::upper_bound( keys.begin(), keys.end(), std::make_pair( Extractor()( _item->value ), _item->primary ) );
+                        _item = at == keys.end() ? nullptr : _mi->load( at->second );
+                        return *this;
+                     }
+
+                     friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._item == b._item; }
+                     friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._item != b._item; }
+
+                  private:
+                     friend class index;
+
+                     const_iterator( const multi_index* mi, const item* i ) : _mi( mi ), _item( i ) {}
+
+                     const multi_index* _mi = nullptr;
+                     const item*        _item = nullptr;
+               };
+
+               const_iterator begin()const
+               {
+                  auto keys = _multidx->template secondary_order<Extractor>();
+                  return at( keys.empty() ? nullptr : _multidx->load( keys.front().second ) );
+               }
+               const_iterator end()const    { return at( nullptr ); }
+               const_iterator cbegin()const { return begin(); }
+               const_iterator cend()const   { return end(); }
+
+               const_iterator lower_bound( const secondary_key_type& key )const
+               {
+                  auto keys = _multidx->template secondary_order<Extractor>();
+                  auto it = std::lower_bound( keys.begin(), keys.end(), key, []( const auto& k, const auto& v ) { return k.first < v; } );
+                  return at( it == keys.end() ? nullptr : _multidx->load( it->second ) );
+               }
+
+               const_iterator upper_bound( const secondary_key_type& key )const
+               {
+                  auto keys = _multidx->template secondary_order<Extractor>();
+                  auto it = std::upper_bound( keys.begin(), keys.end(), key, []( const auto& v, const auto& k ) { return v < k.first; } );
+                  return at( it == keys.end() ? nullptr : _multidx->load( it->second ) );
+               }
+
+               const_iterator find( const secondary_key_type& key )const
+               {
+                  auto it = lower_bound( key );
+                  if( it != end() && Extractor()( *it ) != key ) return end();
+                  return it;
+               }
+
+               const T& get( const secondary_key_type& key, const char* error_msg = "unable to find secondary key" )const
+               {
+                  auto it = find( key );
+                  eosio::check( it != end(), error_msg );
+                  return *it;
+               }
+
+               const_iterator iterator_to( const T& obj )const
+               {
+                  return at( &_multidx->cached( obj, "object passed to iterator_to is not in multi_index" ) );
+               }
+
+               template<typename Lambda>
+               void modify( const_iterator itr, name payer, Lambda&& updater )
+               {
+                  eosio::check( itr != end(), "cannot pass end iterator to modify" );
+                  _multidx->modify( *itr, payer, std::forward<Lambda>( updater ) );
+               }
+
+               const_iterator erase( const_iterator itr )
+               {
+                  eosio::check( itr != end(), "cannot pass end iterator to erase" );
+                  const auto& obj = *itr;
+                  ++itr;
+                  _multidx->erase( obj );
+                  return itr;
+               }
+
+               name     get_code()const  { return _multidx->get_code(); }
+               uint64_t get_scope()const { return _multidx->get_scope(); }
+
+            private:
+               friend class multi_index;
+
+               explicit index( multi_index* mi ) : _multidx( mi ) {}
+
+               const_iterator at( const item* i )const { return const_iterator( _multidx, i ); }
+
+               multi_index* _multidx;
+         };
+
+         multi_index( name code, uint64_t scope ) : _code( code ), _scope( scope ) {}
+
+         multi_index( const multi_index& ) = delete;
+         multi_index& operator=( const multi_index& ) = delete;
+
+         name     get_code()const  { return _code; }
+         uint64_t get_scope()const { return _scope; }
+
+         const_iterator begin()const  { return const_iterator( this, load_at( []( auto& r ) { return r.begin(); } ) ); }
+         const_iterator end()const    { return const_iterator( this, nullptr ); }
+         const_iterator cbegin()const { return begin(); }
+         const_iterator cend()const   { return end(); }
+
+         const_iterator lower_bound( uint64_t primary )const
+         {
+            return const_iterator( this, load_at( [&]( auto& r ) { return r.lower_bound( primary ); } ) );
+         }
+
+         const_iterator upper_bound( uint64_t primary )const
+         {
+            return const_iterator( this, load_at( [&]( auto& r ) { return r.upper_bound( primary ); } ) );
+         }
+
+         const_iterator find( uint64_t primary )const
+         {
+            return const_iterator( this, load( primary ) );
+         }
+
+         const T& get( uint64_t primary, const char* error_msg = "unable to find key" )const
+         {
+            const item* i = load( primary );
+            eosio::check( i != nullptr, error_msg );
+            return i->value;
+         }
+
+         const_iterator iterator_to( const T& obj )const
+         {
+            return const_iterator( this, &cached( obj, "object passed to iterator_to is not in multi_index" ) );
+         }
+
+         uint64_t available_primary_key()const
+         {
+            auto* r = rows();
+            if( !r || r->empty() ) return 0;
+            uint64_t last = std::prev( r->end() )->first;
+            eosio::check( last < static_cast<uint64_t>( -2 ), "next primary key in table is at autoincrement limit" );
+            return last + 1;
+         }
+
+         template<name::raw IndexName>
+         auto get_index()
+         {
+            using found = decltype( find_index<IndexName, Indices...>() );
+            return index<IndexName, typename found::secondary_extractor_type>( this );
+         }
+
+         template<name::raw IndexName>
+         auto get_index()const
+         {
+            using found = decltype( find_index<IndexName, Indices...>() );
+            return index<IndexName, typename found::secondary_extractor_type>( const_cast<multi_index*>( this ) );
+         }
+
+         template<typename Lambda>
+         const_iterator emplace( name payer, Lambda&& constructor )
+         {
+            eosio::check( _code.value == native::current_receiver(), "cannot create objects in table of another contract" );
+            eosio::check( payer != same_payer && native::is_account( payer.value ), "must specify a valid account to pay for new record" );
+
+            auto i = std::make_unique<item>();
+            constructor( i->value );
+            i->primary = i->value.primary_key();
+
+            auto* r = rows( true );
+            eosio::check( r->find( i->primary ) == r->end(), "could not insert object, most likely a uniqueness constraint was violated" );
+            ( *r )[i->primary] = native::stored_row{ pack( i->value ), payer.value };
+
+            auto& slot = _items[i->primary];
+            slot = std::move( i );
+            return const_iterator( this, slot.get() );
+         }
+
+         template<typename Lambda>
+         void modify( const_iterator itr, name payer, Lambda&& updater )
+         {
+            eosio::check( itr != end(), "cannot pass end iterator to modify" );
+            modify( *itr, payer, std::forward<Lambda>( updater ) );
+         }
+
+         template<typename Lambda>
+         void modify( const T& obj, name payer, Lambda&& updater )
+         {
+            eosio::check( _code.value == native::current_receiver(), "cannot modify objects in table of another contract" );
+            item& i = cached( obj, "object passed to modify is not in multi_index" );
+
+            updater( i.value );
+            eosio::check( i.primary == i.value.primary_key(), "updater cannot change primary key when modifying an object" );
+
+            auto& row = rows()->at( i.primary );
+            row.data = pack( i.value );
+            if( payer != same_payer ) row.payer = payer.value;
+         }
+
+         const_iterator erase( const_iterator itr )
+         {
+            eosio::check( itr != end(), "cannot pass end iterator to erase" );
+            const auto& obj = *itr;
+            ++itr;
+            erase( obj );
+            return itr;
+         }
+
+         void erase( const T& obj )
+         {
+            eosio::check( _code.value == native::current_receiver(), "cannot erase objects in table of another contract" );
+            item& i = cached( obj, "object passed to erase is not in multi_index" );
+            rows()->erase( i.primary );
+            native::db_drop_if_empty( _code.value, _scope, static_cast<uint64_t>( TableName ) );
+
+            auto slot = _items.find( i.primary );
+            _erased.push_back( std::move( slot->second ) );
+            _items.erase( slot );
+         }
+   };
+
+} /// namespace eosio
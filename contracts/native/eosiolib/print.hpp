@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../host.hpp"
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace eosio {
+
+   namespace detail {
+      template<typename T, typename = void>
+      struct has_print : std::false_type {};
+
+      template<typename T>
+      struct has_print<T, std::void_t<decltype( std::declval<const T&>().print() )>> : std::true_type {};
+   }
+
+   inline void print( const char* s )        { native::console( s ); }
+   inline void print( const std::string& s ) { native::console( s ); }
+   inline void print( char c )               { native::console( std::string( 1, c ) ); }
+   inline void print( bool b )               { native::console( b ? "true" : "false" ); }
+
+   template<typename T>
+   void print( const T& t )
+   {
+      if constexpr( detail::has_print<T>::value ) t.print();
+      else if constexpr( std::is_integral_v<T> ) native::console( std::to_string( t ) );
+      else static_assert( detail::has_print<T>::value, "type cannot be printed" );
+   }
+
+   template<typename A, typename B, typename... Args>
+   void print( A&& a, B&& b, Args&&... args )
+   {
+      print( std::forward<A>( a ) );
+      print( std::forward<B>( b ) );
+      ( print( std::forward<Args>( args ) ), ... );
+   }
+
+} /// namespace eosio
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "../host.hpp"
+
+#include <cstdint>
+#include <string>
+
+inline void eosio_assert( uint32_t test, const char* msg )
+{
+   if( !test ) native::fail( msg );
+}
+
+inline uint32_t now()
+{
+   return native::now();
+}
+
+inline uint32_t action_data_size()
+{
+   return native::action_data_size();
+}
+
+inline uint32_t read_action_data( void* msg, uint32_t len )
+{
+   native::read_action_data( msg, len );
+   return len;
+}
+
+namespace eosio {
+
+   inline void check( bool pred, const char* msg )
+   {
+      if( !pred ) native::fail( msg );
+   }
+
+   inline void check( bool pred, const std::string& msg )
+   {
+      if( !pred ) native::fail( msg );
+   }
+
+} /// namespace eosio
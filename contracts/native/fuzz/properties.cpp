@@ -0,0 +1,356 @@
+#include "../tests/fixture.hpp"
+
+#include "../../common/buyer_shard.hpp"
+
+#include <eosiolib/binary_extension.hpp>
+#include <eosiolib/crypto.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// Random interleavings of token, crowdsale and team actions through the
+// native chain, with the conservation laws of the three contracts checked
+// against the tables after every step:
+//
+//  - the MPT supply is every balance plus the drop escrow, and the holder
+//    counters agree with the balance rows
+//  - what the crowdsale owes buyers plus its unlocked funds is funds_total
+//    plus the funds of the unsettled shards, and the EOS it holds covers
+//    that, the queued orders and the pending refunds
+//  - metpackteam never owes more than it holds
+//
+// Rejected actions are part of the run, they have to leave the tables as
+// they were. Prints accepted and rejected counts by action at the end.
+// Usage: metpack_properties [steps] [seed]
+
+using namespace fixture;
+
+namespace {
+
+   const std::vector<name> people{ name( "alice" ), name( "bob" ), name( "carol" ), name( "dave" ) };
+
+   // prefixes of the rows the laws read
+   struct balance_row {
+      asset balance;
+      bool  claimed;
+   };
+
+   struct holder_counters {
+      uint64_t holders;
+      asset    claimed;
+      asset    unclaimed;
+      asset    circulating;
+   };
+
+   struct token_stats {
+      asset supply;
+      asset max_supply;
+      name  issuer;
+      eosio::binary_extension<bool>            holder_registry;
+      eosio::binary_extension<holder_counters> counters;
+   };
+
+   struct merkle_drop {
+      uint64_t            id;
+      eosio::checksum256  root;
+      uint64_t            leaves;
+      asset               total;
+      asset               claimed;
+   };
+
+   struct queued_drop {
+      uint64_t id;
+      name     to;
+      asset    quantity;
+      eosio::binary_extension<bool> reserved;
+   };
+
+   struct sale_stats {
+      name     token_contract;
+      name     owner;
+      asset    available_tokens;
+      asset    minimum_buy;
+      asset    funds_total;
+      asset    funds_unlocked;
+   };
+
+   struct sale_shard {
+      uint64_t id;
+      asset    allotment;
+      asset    tokens_sold;
+      asset    funds_in;
+      asset    tokens_unlocked;
+      eosio::binary_extension<asset> funds_unlocked;
+   };
+
+   struct sale_buyer {
+      name  buyer_name;
+      asset tokens_untouched;
+      eosio::binary_extension<asset> funds_untouched;
+   };
+
+   struct sale_order {
+      uint64_t id;
+      name     buyer_name;
+      asset    payment;
+   };
+
+   struct sale_payout {
+      name  buyer_name;
+      asset tokens;
+      asset funds;
+      asset refund;
+   };
+
+   struct team_stat {
+      name     tokencontract;
+      eosio::symbol currency;
+      uint32_t airdropTimestamp;
+      uint32_t lockupPeriodSeconds;
+      uint64_t totalCredit;
+   };
+
+   // every row of one table of code over all scopes
+   template<typename T>
+   std::vector<T> all_rows( name code, name table )
+   {
+      std::vector<T> result;
+      for( const auto& [id, rows] : chain().tables )
+      {
+         if( id.code != code.value || id.table != table.value ) continue;
+         for( const auto& r : rows ) result.push_back( eosio::unpack<T>( r.second.data ) );
+      }
+      return result;
+   }
+
+   [[noreturn]] void law_broken( const std::string& what, uint64_t step, const std::string& action )
+   {
+      std::cerr << "law broken after step " << step << " (" << action << "): " << what << "\n";
+      std::exit( 1 );
+   }
+
+   void check_laws( uint64_t step, const std::string& action )
+   {
+      auto fail = [&]( const std::string& what ) { law_broken( what, step, action ); };
+
+      // token supply
+      auto st = *native::test::row<token_stats>( token, mpt_symbol.code().raw(), name( "stat" ), mpt_symbol.code().raw() );
+      int64_t balances = 0, circulating = 0, claimed = 0;
+      uint64_t holders = 0;
+      for( const auto& [id, rows] : chain().tables )
+      {
+         if( id.code != token.value || id.table != name( "accounts" ).value ) continue;
+         for( const auto& r : rows )
+         {
+            auto b = eosio::unpack<balance_row>( r.second.data );
+            balances += b.balance.amount;
+            if( b.claimed ) claimed += b.balance.amount;
+            holders += b.balance.amount > 0;
+            if( id.scope != st.issuer.value && id.scope != sale.value && id.scope != token.value ) circulating += b.balance.amount;
+         }
+      }
+      int64_t escrow = 0;
+      for( const auto& d : all_rows<merkle_drop>( token, name( "drops" ) ) ) escrow += d.total.amount - d.claimed.amount;
+      for( const auto& q : all_rows<queued_drop>( token, name( "dropqueue" ) ) ) escrow += q.reserved.value_or() ? q.quantity.amount : 0;
+      if( balances + escrow != st.supply.amount )
+         fail( "supply " + std::to_string( st.supply.amount ) + " != balances " + std::to_string( balances ) + " + escrow " + std::to_string( escrow ) );
+      const auto& c = st.counters.value();
+      if( c.claimed.amount != claimed ) fail( "claimed counter " + std::to_string( c.claimed.amount ) + " != " + std::to_string( claimed ) );
+      if( c.claimed.amount + c.unclaimed.amount != st.supply.amount ) fail( "claimed + unclaimed counters != supply" );
+      if( c.circulating.amount != circulating ) fail( "circulating counter " + std::to_string( c.circulating.amount ) + " != " + std::to_string( circulating ) );
+      if( c.holders != holders ) fail( "holders counter " + std::to_string( c.holders ) + " != " + std::to_string( holders ) );
+
+      // crowdsale funds
+      auto sale_st = *native::test::row<sale_stats>( sale, sale.value, name( "stats" ), token.value );
+      int64_t funds_in = 0, unlocked = sale_st.funds_unlocked.amount, owed = 0, queued = 0, refunds = 0;
+      for( const auto& s : all_rows<sale_shard>( sale, name( "shards" ) ) )
+      {
+         funds_in += s.funds_in.amount;
+         unlocked += s.funds_unlocked.value_or( asset( 0, eos_symbol ) ).amount;
+      }
+      for( const auto& b : all_rows<sale_buyer>( sale, name( "buyers" ) ) ) owed += b.funds_untouched.value_or( asset( 0, eos_symbol ) ).amount;
+      for( const auto& p : all_rows<sale_payout>( sale, name( "payouts" ) ) )
+      {
+         owed += p.funds.amount;
+         refunds += p.refund.amount;
+      }
+      for( const auto& o : all_rows<sale_order>( sale, name( "orders" ) ) ) queued += o.payment.amount;
+      if( owed + unlocked != sale_st.funds_total.amount + funds_in )
+         fail( "buyer funds " + std::to_string( owed ) + " + unlocked " + std::to_string( unlocked ) + " != funds_total "
+               + std::to_string( sale_st.funds_total.amount ) + " + shard funds " + std::to_string( funds_in ) );
+      if( eos_of( sale ).amount != sale_st.funds_total.amount + funds_in + queued + refunds )
+         fail( "crowdsale holds " + eos_of( sale ).to_string() + " but accounts for "
+               + std::to_string( sale_st.funds_total.amount + funds_in + queued + refunds ) );
+
+      // team credit
+      auto ts = *native::test::row<team_stat>( team, team.value, name( "stats" ), token.value );
+      if( ts.totalCredit > static_cast<uint64_t>( mpt_of( team ).amount ) )
+         fail( "team owes " + std::to_string( ts.totalCredit ) + " but holds " + mpt_of( team ).to_string() );
+   }
+
+   void setup()
+   {
+      native::deploy_contracts();
+      for( name p : people ) chain().create_account( p );
+      create_eos();
+      for( name p : people ) give_eos( p, eos( 1'000'0000 ) );
+      // headroom under the max supply for queued airdrops
+      chain().push( token, name( "create" ), { token }, token, mpt( 10'000'000'0000 ) );
+      chain().push( token, name( "issue" ), { token }, token, mpt( 5'000'000'0000 ), std::string( "supply" ) );
+      send_mpt( token, sale, mpt( 1'000'000'0000 ) );
+      chain().push( sale, name( "addtoken" ), { sale },
+                    token, token, mpt( 1'000'000'0000 ), eos( 1'0000 ), eos( 0 ),
+                    uint64_t( 10 ), uint64_t( 3 ), sale_start, sale_end, buyback_start, buyback_end );
+      send_mpt( token, team, mpt( 100'000'0000 ) );
+      chain().push( team, name( "addtoken" ), { team }, token, mpt_symbol, uint32_t( 500 ), uint32_t( 2000 ) );
+      chain().push( team, name( "addschedule" ), { team }, uint64_t( 0 ), uint32_t( 500 ), uint32_t( 300 ), uint32_t( 3000 ) );
+   }
+
+   class runner {
+      public:
+         explicit runner( uint64_t seed ) : _rng( seed ) {}
+
+         // one random action, its name
+         std::string step()
+         {
+            switch( pick( 21 ) )
+            {
+               case 0:  advance(); return "advance";
+               case 1:  { name f = person(), t = anyone(); try_push( token, "transfer", { f }, f, t, mpt( amount() ), std::string() ); return "transfer"; }
+               case 2:  { name f = person();
+                          std::vector<std::pair<name, asset>> batch{ { anyone(), mpt( amount() ) }, { anyone(), mpt( amount() ) } };
+                          try_push( token, "transferbatch", { f }, f, batch, std::string() ); return "transferbatch"; }
+               case 3:  { name o = person(), s = person(); try_push( token, "approve", { o }, o, s, mpt( amount() ) ); return "approve"; }
+               case 4:  { name s = person(), f = anyone(), t = anyone(); try_push( token, "transferfrom", { s }, s, f, t, mpt( amount() ), std::string() ); return "transferfrom"; }
+               case 5:  { name p = person(); try_push( token, "claim", { p }, p, mpt_symbol ); return "claim"; }
+               case 6:  { try_push( token, "recover", { token }, person(), mpt_symbol ); return "recover"; }
+               case 7:  { try_push( token, "retire", { token }, mpt( amount() ), std::string() ); return "retire"; }
+               case 8:  { std::vector<std::pair<name, asset>> drops{ { person(), mpt( amount() ) }, { person(), mpt( amount() ) } };
+                          try_push( token, "queuedrop", { token }, drops ); return "queuedrop"; }
+               case 9:  { try_push( token, "drain", { token }, mpt_symbol, uint32_t( 1 + pick( 3 ) ) ); return "drain"; }
+               case 10: { try_push( token, "unqueue", { token }, mpt_symbol, std::vector<uint64_t>{ pick( 8 ) } ); return "unqueue"; }
+               case 11: commit_or_claim_drop(); return "drop";
+               case 12: { name p = person(); try_push( system_token, "transfer", { p }, p, sale, eos( 1'0000 + amount() ), std::string() ); return "buy"; }
+               case 13: { name p = person(); try_push( token, "transfer", { p }, p, sale, mpt( amount() ), std::string() ); return "return"; }
+               case 14: { try_push( sale, "claimfunds", { token }, token ); return "claimfunds"; }
+               case 15: { try_push( sale, "settle", { sale }, token ); return "settle"; }
+               case 16: { try_push( sale, "setqueue", { sale }, token, pick( 2 ) == 0 ); return "setqueue"; }
+               case 17: { try_push( sale, "fillorders", { person() }, metpack::buyer_shard( person() ), uint32_t( 1 + pick( 4 ) ) ); return "fillorders"; }
+               case 18: { try_push( sale, "claimorder", { person() }, person() ); return "claimorder"; }
+               case 19: { if( pick( 2 ) ) try_push( team, "addmember", { team }, person(), token, mpt( amount() * 100 ) );
+                          else try_push( team, "addvested", { team }, person(), token, mpt( amount() * 100 ), uint64_t( 0 ) );
+                          return "addmember"; }
+               default: { name p = person(); try_push( team, "withdraw", { p }, p, token, mpt_symbol ); return "withdraw"; }
+            }
+         }
+
+         uint64_t accepted = 0;
+         uint64_t rejected = 0;
+
+         // accepted and rejected by action, an action that stops being
+         // accepted after a change shows up here
+         std::map<std::string, std::pair<uint64_t, uint64_t>> outcomes;
+
+      private:
+         uint64_t pick( uint64_t n ) { return std::uniform_int_distribution<uint64_t>( 0, n - 1 )( _rng ); }
+
+         // mostly small amounts, sometimes all of a balance or more
+         int64_t amount()
+         {
+            switch( pick( 4 ) )
+            {
+               case 0:  return 1 + pick( 10 );
+               case 1:  return 1 + pick( 100'0000 );
+               case 2:  return 1 + pick( 10'000'0000 );
+               default: return 1 + pick( 1'000'000'0000 );
+            }
+         }
+
+         name person() { return people[pick( people.size() )]; }
+
+         // a person most of the time, the contracts themselves as recipients,
+         // never as senders, the contract keys stay with their owners
+         name anyone()
+         {
+            switch( pick( 8 ) )
+            {
+               case 0:  return sale;
+               case 1:  return team;
+               case 2:  return token;
+               default: return person();
+            }
+         }
+
+         void advance()
+         {
+            chain().time += static_cast<uint32_t>( pick( 250 ) );
+         }
+
+         // single leaf drops, the proof is empty and the root is the leaf
+         void commit_or_claim_drop()
+         {
+            name owner = person();
+            asset quantity = mpt( amount() );
+            uint64_t id = pick( 4 );
+            auto packed = eosio::pack( std::make_tuple( uint64_t( 0 ), owner, quantity ) );
+            auto leaf = eosio::sha256( packed.data(), static_cast<uint32_t>( packed.size() ) );
+            switch( pick( 3 ) )
+            {
+               case 0:  try_push( token, "commitdrop", { token }, id, leaf, quantity, uint64_t( 1 ) ); break;
+               case 1:  try_push( token, "claimdrop", { owner }, owner, id, quantity, uint64_t( 0 ), std::vector<eosio::checksum256>() ); break;
+               default: try_push( token, "closedrop", { token }, mpt_symbol, id ); break;
+            }
+         }
+
+         template<typename... Args>
+         void try_push( name account, const char* act, std::vector<name> actors, const Args&... args )
+         {
+            try {
+               chain().push( account, name( act ), std::move( actors ), args... );
+               ++accepted;
+               ++outcomes[act].first;
+            } catch( const native::assert_failure& ) {
+               ++rejected;
+               ++outcomes[act].second;
+            }
+         }
+
+         std::mt19937_64 _rng;
+   };
+
+}
+
+int main( int argc, char** argv )
+{
+   uint64_t steps = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 10000;
+   uint64_t seed  = argc > 2 ? std::strtoull( argv[2], nullptr, 10 ) : 1;
+
+   setup();
+   check_laws( 0, "setup" );
+   runner r( seed );
+   auto start = std::chrono::steady_clock::now();
+   for( uint64_t i = 1; i <= steps; ++i )
+   {
+      auto before = chain().tables;
+      uint64_t rejected = r.rejected;
+      std::string action = r.step();
+      if( r.rejected != rejected && chain().tables != before ) law_broken( "a rejected action changed the tables", i, action );
+      check_laws( i, action );
+   }
+   double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+   std::cout << "{\"steps\":" << steps << ",\"seed\":" << seed << ",\"accepted\":" << r.accepted << ",\"rejected\":" << r.rejected
+             << ",\"steps_per_second\":" << ( seconds > 0 ? steps / seconds : 0 ) << ",\"actions\":{";
+   bool first = true;
+   for( const auto& [act, outcome] : r.outcomes )
+   {
+      std::cout << ( first ? "" : "," ) << "\"" << act << "\":[" << outcome.first << "," << outcome.second << "]";
+      first = false;
+   }
+   std::cout << "}}\n";
+   return 0;
+}
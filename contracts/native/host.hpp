@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// What the emulated eosiolib headers need from the host chain in chain.cpp.
+// Plain integers only, so the eosiolib headers can include it first.
+namespace native {
+
+   // eosio_assert and check throw this, the chain rolls the transaction back
+   struct assert_failure : std::runtime_error {
+      using std::runtime_error::runtime_error;
+   };
+
+   [[noreturn]] void fail( const std::string& msg );
+
+   void     console( std::string_view text );
+   uint32_t now();
+
+   // data and context of the action being applied
+   uint32_t action_data_size();
+   void     read_action_data( void* buffer, uint32_t size );
+   uint64_t current_receiver();
+   bool     has_auth( uint64_t account );
+   void     require_recipient( uint64_t account );
+   bool     is_account( uint64_t account );
+
+   struct permission {
+      uint64_t actor;
+      uint64_t permission;
+   };
+
+   void send_inline( uint64_t account, uint64_t action, const std::vector<permission>& auth, std::vector<char> data );
+
+   // one stored row, packed like the chain stores it
+   struct stored_row {
+      std::vector<char> data;
+      uint64_t          payer = 0;
+
+      friend bool operator==( const stored_row& a, const stored_row& b ) { return a.data == b.data && a.payer == b.payer; }
+   };
+
+   using table_rows = std::map<uint64_t, stored_row>;
+
+   // rows of code/scope/table, nullptr when the table is empty and create is false
+   table_rows* db_table( uint64_t code, uint64_t scope, uint64_t table, bool create );
+   void        db_drop_if_empty( uint64_t code, uint64_t scope, uint64_t table );
+
+} /// namespace native
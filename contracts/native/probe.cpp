@@ -0,0 +1,73 @@
+#include "probe.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace native {
+
+   namespace {
+
+      // one {"action":"...","key":number,...} record, false for any other line
+      bool parse_record( const std::string& line, probe_record& record )
+      {
+         static const std::string head = "{\"action\":\"";
+         if( line.compare( 0, head.size(), head ) != 0 ) return false;
+         size_t pos = line.find( '"', head.size() );
+         if( pos == std::string::npos ) return false;
+         record.action = line.substr( head.size(), pos - head.size() );
+         ++pos;
+         while( pos < line.size() && line[pos] == ',' )
+         {
+            size_t key_end = line.find( "\":", pos + 2 );
+            if( line.compare( pos, 2, ",\"" ) != 0 || key_end == std::string::npos ) return false;
+            std::string key = line.substr( pos + 2, key_end - pos - 2 );
+            char* end = nullptr;
+            int64_t value = std::strtoll( line.c_str() + key_end + 2, &end, 10 );
+            if( end == line.c_str() + key_end + 2 ) return false;
+            record.counters.emplace_back( std::move( key ), value );
+            pos = end - line.c_str();
+         }
+         return pos < line.size() && line[pos] == '}';
+      }
+
+   }
+
+   std::vector<probe_record> probe_records( const std::vector<action_trace>& traces )
+   {
+      std::vector<probe_record> records;
+      for( const auto& t : traces )
+      {
+         size_t start = 0;
+         while( start < t.console.size() )
+         {
+            size_t end = t.console.find( '\n', start );
+            if( end == std::string::npos ) end = t.console.size();
+            // a record can follow whatever the action printed itself
+            size_t open = t.console.rfind( "{\"action\":\"", end );
+            if( open != std::string::npos && open >= start )
+            {
+               probe_record record{ t.receiver, t.code, {}, {} };
+               if( parse_record( t.console.substr( open, end - open ), record ) ) records.push_back( std::move( record ) );
+            }
+            start = end + 1;
+         }
+      }
+      return records;
+   }
+
+   std::vector<std::pair<std::string, int64_t>> sum_counters( const std::vector<probe_record>& records )
+   {
+      std::vector<std::pair<std::string, int64_t>> total;
+      for( const auto& r : records )
+      {
+         for( const auto& c : r.counters )
+         {
+            auto it = std::find_if( total.begin(), total.end(), [&]( const auto& t ) { return t.first == c.first; } );
+            if( it == total.end() ) total.push_back( c );
+            else it->second += c.second;
+         }
+      }
+      return total;
+   }
+
+} /// namespace native
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "chain.hpp"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Reads back the records metpack::action_probe prints with METPACK_INSTRUMENT,
+// one per action a contract applied, from the console of the traces
+namespace native {
+
+   struct probe_record {
+      name                                         receiver;
+      name                                         code;
+      std::string                                  action;
+      std::vector<std::pair<std::string, int64_t>> counters;   // in printed order
+   };
+
+   std::vector<probe_record> probe_records( const std::vector<action_trace>& traces );
+
+   // counters of all records added up by name, in the order first seen
+   std::vector<std::pair<std::string, int64_t>> sum_counters( const std::vector<probe_record>& records );
+
+} /// namespace native
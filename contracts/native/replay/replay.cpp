@@ -0,0 +1,291 @@
+#include "../chain.hpp"
+#include "../probe.hpp"
+
+#include <eosiolib/crypto.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Replays a recorded action log against the instrumented contracts, one
+// transaction per line:
+//
+//   {"contract":"metpacktoken","action":"transfer","auth":["alice@active"],
+//    "data":"<hex of the packed action data>","block_time":"2019-06-01T12:00:00.000"}
+//
+// data is the hex_data history nodes keep, block_time seconds or the ISO
+// time of the block. eosio::newaccount lines create the account they name,
+// other eosio actions are skipped, so an account that lets a contract send
+// inline actions with its authority is given with --grant actor=contract.
+//
+// Prints one json summary: throughput, the probe counters of every receiver
+// and action added up, failed lines and a sha256 of all tables, so two
+// revisions replaying the same log can be compared. --trace also prints
+// every probe record as it happens. Exits non-zero when a line fails, a
+// recorded action failing is a change in behaviour.
+
+namespace {
+
+   using native::name;
+
+   struct logged_action {
+      std::string              contract;
+      std::string              action;
+      std::vector<std::string> auth;
+      std::string              data;
+      std::string              block_time;
+   };
+
+   // the flat objects of the log: string, number and string array values
+   class line_reader {
+      public:
+         explicit line_reader( const std::string& line ) : _s( line ) {}
+
+         logged_action read()
+         {
+            logged_action a;
+            expect( '{' );
+            while( !peek( '}' ) )
+            {
+               std::string key = string();
+               expect( ':' );
+               if( key == "contract" ) a.contract = string();
+               else if( key == "action" ) a.action = string();
+               else if( key == "data" ) a.data = string();
+               else if( key == "block_time" ) a.block_time = peek( '"' ) ? string() : number();
+               else if( key == "auth" )
+               {
+                  expect( '[' );
+                  while( !peek( ']' ) )
+                  {
+                     a.auth.push_back( string() );
+                     if( !peek( ']' ) ) expect( ',' );
+                  }
+                  expect( ']' );
+               }
+               else skip_value();
+               if( !peek( '}' ) ) expect( ',' );
+            }
+            expect( '}' );
+            return a;
+         }
+
+      private:
+         void space() { while( _pos < _s.size() && std::isspace( static_cast<unsigned char>( _s[_pos] ) ) ) ++_pos; }
+
+         bool peek( char c )
+         {
+            space();
+            return _pos < _s.size() && _s[_pos] == c;
+         }
+
+         void expect( char c )
+         {
+            if( !peek( c ) ) throw std::runtime_error( std::string( "expected '" ) + c + "' at column " + std::to_string( _pos ) );
+            ++_pos;
+         }
+
+         std::string string()
+         {
+            expect( '"' );
+            std::string out;
+            while( _pos < _s.size() && _s[_pos] != '"' )
+            {
+               if( _s[_pos] == '\\' && _pos + 1 < _s.size() ) ++_pos;
+               out += _s[_pos++];
+            }
+            expect( '"' );
+            return out;
+         }
+
+         std::string number()
+         {
+            space();
+            size_t start = _pos;
+            while( _pos < _s.size() && ( std::isdigit( static_cast<unsigned char>( _s[_pos] ) ) || _s[_pos] == '-' || _s[_pos] == '.' ) ) ++_pos;
+            if( start == _pos ) throw std::runtime_error( "expected a value at column " + std::to_string( _pos ) );
+            return _s.substr( start, _pos - start );
+         }
+
+         void skip_value()
+         {
+            if( peek( '"' ) ) { string(); return; }
+            if( peek( '[' ) || peek( '{' ) )
+            {
+               int depth = 0;
+               do {
+                  if( _s[_pos] == '"' ) { string(); continue; }
+                  if( _s[_pos] == '[' || _s[_pos] == '{' ) ++depth;
+                  if( _s[_pos] == ']' || _s[_pos] == '}' ) --depth;
+                  ++_pos;
+               } while( depth > 0 && _pos < _s.size() );
+               return;
+            }
+            while( _pos < _s.size() && _s[_pos] != ',' && _s[_pos] != '}' ) ++_pos;
+         }
+
+         const std::string& _s;
+         size_t             _pos = 0;
+   };
+
+   std::vector<char> from_hex( const std::string& hex )
+   {
+      if( hex.size() % 2 ) throw std::runtime_error( "odd length hex data" );
+      std::vector<char> out( hex.size() / 2 );
+      for( size_t i = 0; i < out.size(); ++i ) out[i] = static_cast<char>( std::stoi( hex.substr( 2 * i, 2 ), nullptr, 16 ) );
+      return out;
+   }
+
+   uint32_t block_seconds( const std::string& t )
+   {
+      if( t.empty() ) return native::chain::get().time;
+      if( t.find( '-' ) == std::string::npos ) return static_cast<uint32_t>( std::stoul( t ) );
+      std::tm tm{};
+      std::istringstream in( t );
+      in >> std::get_time( &tm, "%Y-%m-%dT%H:%M:%S" );
+      if( in.fail() ) throw std::runtime_error( "bad block_time " + t );
+      return static_cast<uint32_t>( timegm( &tm ) );
+   }
+
+   std::vector<eosio::permission_level> permissions( const std::vector<std::string>& auth )
+   {
+      std::vector<eosio::permission_level> out;
+      for( const auto& a : auth )
+      {
+         auto at = a.find( '@' );
+         out.emplace_back( name( a.substr( 0, at ) ), name( at == std::string::npos ? std::string( "active" ) : a.substr( at + 1 ) ) );
+      }
+      return out;
+   }
+
+   // every row of every table in key order with its payer
+   std::string state_digest()
+   {
+      std::vector<char> state;
+      auto put = [&]( uint64_t v ) { state.insert( state.end(), reinterpret_cast<char*>( &v ), reinterpret_cast<char*>( &v ) + sizeof( v ) ); };
+      for( const auto& [id, rows] : native::chain::get().tables )
+      {
+         put( id.code );
+         put( id.scope );
+         put( id.table );
+         for( const auto& [primary, row] : rows )
+         {
+            put( primary );
+            put( row.payer );
+            put( row.data.size() );
+            state.insert( state.end(), row.data.begin(), row.data.end() );
+         }
+      }
+      auto hash = eosio::sha256( state.data(), static_cast<uint32_t>( state.size() ) ).extract_as_byte_array();
+      std::ostringstream hex;
+      for( auto b : hash ) hex << std::hex << std::setw( 2 ) << std::setfill( '0' ) << int( b );
+      return hex.str();
+   }
+
+   struct action_totals {
+      uint64_t                                   count = 0;
+      std::vector<std::pair<std::string, int64_t>> counters;
+   };
+
+}
+
+int main( int argc, char** argv )
+{
+   auto& c = native::deploy_contracts();
+   const char* path = nullptr;
+   bool trace = false;
+   bool usage = argc < 2;
+   for( int i = 1; i < argc; ++i )
+   {
+      std::string arg = argv[i];
+      if( arg == "--trace" ) trace = true;
+      else if( arg == "--grant" && i + 1 < argc )
+      {
+         std::string grant = argv[++i];
+         auto eq = grant.find( '=' );
+         if( eq == std::string::npos ) usage = true;
+         else c.grant_code( name( grant.substr( 0, eq ) ), name( grant.substr( eq + 1 ) ) );
+      }
+      else path = argv[i];
+   }
+   if( usage || !path )
+   {
+      std::cerr << "usage: metpack_replay [--trace] [--grant actor=contract]... <action log>\n";
+      return 2;
+   }
+   std::ifstream in( path );
+   if( !in )
+   {
+      std::cerr << "cannot read " << path << "\n";
+      return 2;
+   }
+
+   std::map<std::string, action_totals> totals;
+   uint64_t applied = 0;
+   uint64_t failed = 0;
+   std::chrono::nanoseconds busy{ 0 };
+   std::string line;
+   for( uint64_t number = 1; std::getline( in, line ); ++number )
+   {
+      if( line.find_first_not_of( " \t\r" ) == std::string::npos ) continue;
+      try {
+         auto a = line_reader( line ).read();
+         c.time = block_seconds( a.block_time );
+         auto data = from_hex( a.data );
+         if( a.contract == "eosio" )
+         {
+            // newaccount starts with the creator and the new name
+            if( a.action == "newaccount" && data.size() >= 16 ) c.create_account( eosio::unpack<std::pair<name, name>>( data ).second );
+            continue;
+         }
+
+         auto start = std::chrono::steady_clock::now();
+         c.push_action( name( a.contract ), name( a.action ), permissions( a.auth ), std::move( data ) );
+         busy += std::chrono::steady_clock::now() - start;
+         ++applied;
+         for( const auto& r : native::probe_records( c.traces() ) )
+         {
+            auto& t = totals[r.receiver.to_string() + ":" + r.action];
+            ++t.count;
+            for( const auto& counter : r.counters )
+            {
+               auto it = std::find_if( t.counters.begin(), t.counters.end(), [&]( const auto& x ) { return x.first == counter.first; } );
+               if( it == t.counters.end() ) t.counters.push_back( counter );
+               else it->second += counter.second;
+            }
+            if( trace )
+            {
+               std::cout << "{\"line\":" << number << ",\"receiver\":\"" << r.receiver.to_string() << "\",\"action\":\"" << r.action << "\"";
+               for( const auto& counter : r.counters ) std::cout << ",\"" << counter.first << "\":" << counter.second;
+               std::cout << "}\n";
+            }
+         }
+      } catch( const std::exception& e ) {
+         ++failed;
+         std::cerr << path << ":" << number << ": " << e.what() << "\n";
+      }
+   }
+
+   double seconds = std::chrono::duration<double>( busy ).count();
+   std::cout << "{\"applied\":" << applied << ",\"failed\":" << failed
+             << ",\"seconds\":" << seconds << ",\"actions_per_second\":" << ( seconds > 0 ? applied / seconds : 0 )
+             << ",\"actions\":{";
+   bool first = true;
+   for( const auto& [key, t] : totals )
+   {
+      std::cout << ( first ? "" : "," ) << "\"" << key << "\":{\"count\":" << t.count;
+      for( const auto& counter : t.counters ) std::cout << ",\"" << counter.first << "\":" << counter.second;
+      std::cout << "}";
+      first = false;
+   }
+   std::cout << "},\"state\":\"" << state_digest() << "\"}\n";
+   return failed == 0 ? 0 : 1;
+}
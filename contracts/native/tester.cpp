@@ -0,0 +1,66 @@
+#include "tester.hpp"
+
+#include <cstring>
+#include <iostream>
+
+namespace native::test {
+
+   namespace {
+      struct test_entry {
+         const char* name;
+         test_fn     fn;
+      };
+
+      std::vector<test_entry>& registry()
+      {
+         static std::vector<test_entry> r;
+         return r;
+      }
+
+      struct check_failure {
+         std::string message;
+      };
+   }
+
+   registrar::registrar( const char* name, test_fn fn )
+   {
+      registry().push_back( test_entry{ name, fn } );
+   }
+
+   void check_failed( const std::string& what, const char* file, int line )
+   {
+      throw check_failure{ std::string( file ) + ":" + std::to_string( line ) + ": " + what };
+   }
+
+   int run( int argc, char** argv )
+   {
+      const char* filter = argc > 1 ? argv[1] : "";
+      int failed = 0;
+      int ran = 0;
+      for( const auto& t : registry() )
+      {
+         if( !std::strstr( t.name, filter ) ) continue;
+         ++ran;
+         deploy_contracts();
+         try {
+            t.fn();
+            std::cout << "ok   " << t.name << "\n";
+         } catch( const check_failure& f ) {
+            ++failed;
+            std::cout << "FAIL " << t.name << "\n  " << f.message << "\n";
+         } catch( const std::exception& e ) {
+            ++failed;
+            std::cout << "FAIL " << t.name << "\n  unexpected exception: " << e.what() << "\n";
+         }
+      }
+      std::cout << ran - failed << " of " << ran << " passed\n";
+      return failed == 0 && ran > 0 ? 0 : 1;
+   }
+
+   eosio::asset balance( name token_contract, name owner, eosio::symbol sym )
+   {
+      auto a = row<eosio::asset>( token_contract, owner.value, name( "accounts" ), sym.code().raw() );
+      return a ? *a : eosio::asset( 0, sym );
+   }
+
+} /// namespace native::test
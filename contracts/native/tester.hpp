@@ -0,0 +1,83 @@
+#pragma once
+
+#include "chain.hpp"
+
+#include <eosiolib/asset.hpp>
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/symbol.hpp>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+// Minimal test runner for the native tests, each TEST_CASE runs on a freshly
+// deployed chain
+namespace native::test {
+
+   using test_fn = void (*)();
+
+   struct registrar {
+      registrar( const char* name, test_fn fn );
+   };
+
+   [[noreturn]] void check_failed( const std::string& what, const char* file, int line );
+
+   // runs the cases whose name contains argv[1], all without an argument
+   int run( int argc, char** argv );
+
+   // row of code/scope/table unpacked as T, T may be a leading-field prefix of the row
+   template<typename T>
+   std::optional<T> row( name code, uint64_t scope, name table, uint64_t primary )
+   {
+      auto t = chain::get().tables.find( table_id{ code.value, scope, table.value } );
+      if( t == chain::get().tables.end() ) return std::nullopt;
+      auto r = t->second.find( primary );
+      if( r == t->second.end() ) return std::nullopt;
+      return eosio::unpack<T>( r->second.data );
+   }
+
+   // every row of code/scope/table unpacked as T, by primary key
+   template<typename T>
+   std::vector<T> rows( name code, uint64_t scope, name table )
+   {
+      std::vector<T> result;
+      auto t = chain::get().tables.find( table_id{ code.value, scope, table.value } );
+      if( t == chain::get().tables.end() ) return result;
+      for( const auto& r : t->second ) result.push_back( eosio::unpack<T>( r.second.data ) );
+      return result;
+   }
+
+   // balance row of a token contract, zero of sym when there is none
+   eosio::asset balance( name token_contract, name owner, eosio::symbol sym );
+
+} /// namespace native::test
+
+#define METPACK_CAT_( a, b ) a##b
+#define METPACK_CAT( a, b ) METPACK_CAT_( a, b )
+
+#define TEST_CASE( NAME ) \
+   static void NAME(); \
+   static native::test::registrar METPACK_CAT( NAME, _registrar )( #NAME, NAME ); \
+   static void NAME()
+
+#define CHECK( COND ) \
+   do { if( !( COND ) ) native::test::check_failed( "CHECK( " #COND " )", __FILE__, __LINE__ ); } while( 0 )
+
+#define CHECK_EQUAL( A, B ) \
+   do { \
+      const auto& a_ = ( A ); \
+      const auto& b_ = ( B ); \
+      if( !( a_ == b_ ) ) native::test::check_failed( "CHECK_EQUAL( " #A ", " #B " )", __FILE__, __LINE__ ); \
+   } while( 0 )
+
+// EXPR has to fail with an assert whose message contains MSG
+#define CHECK_ASSERT( EXPR, MSG ) \
+   do { \
+      bool failed_ = false; \
+      try { EXPR; } catch( const native::assert_failure& e ) { \
+         failed_ = true; \
+         if( std::string( e.what() ).find( MSG ) == std::string::npos ) \
+            native::test::check_failed( std::string( "CHECK_ASSERT( " #EXPR " ) failed with: " ) + e.what(), __FILE__, __LINE__ ); \
+      } \
+      if( !failed_ ) native::test::check_failed( "CHECK_ASSERT( " #EXPR " ) did not fail", __FILE__, __LINE__ ); \
+   } while( 0 )
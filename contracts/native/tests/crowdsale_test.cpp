@@ -0,0 +1,112 @@
+#include "fixture.hpp"
+
+#include "../../common/buyer_shard.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace fixture;
+
+namespace {
+
+   // mptcrowdsale::phase_spec as setphases takes it
+   struct phase_spec {
+      uint32_t start;
+      uint64_t rate;
+      uint64_t ratedenom;
+      asset    allocation;
+      asset    account_cap;
+   };
+
+   // two uncapped phases, 20 MPT per EOS from the sale start and 10 from 1500
+   void two_phases()
+   {
+      std::vector<phase_spec> phases{
+         { sale_start, 20, 1, mpt( 10'000'000'0000 ), mpt( 0 ) },
+         { 1500,       10, 1, mpt( 10'000'000'0000 ), mpt( 0 ) } };
+      chain().push( sale, name( "setphases" ), { sale }, token, phases );
+   }
+
+   // buyer contract that rejects every MPT transfer it is notified of
+   void rejector_apply( uint64_t receiver, uint64_t code, uint64_t action )
+   {
+      if( receiver != code && code == token.value && action == name( "transfer" ).value ) native::fail( "rejects MPT" );
+   }
+
+   // an account name of the same buyer shard as buyer
+   name shard_mate( name buyer, const std::string& prefix )
+   {
+      for( char c = 'a'; c <= 'z'; ++c )
+      {
+         for( char d = 'a'; d <= 'z'; ++d )
+         {
+            name n( prefix + c + d );
+            if( metpack::buyer_shard( n ) == metpack::buyer_shard( buyer ) ) return n;
+         }
+      }
+      native::fail( "no shard mate for " + buyer.to_string() );
+   }
+
+}
+
+TEST_CASE( buy_across_a_phase_boundary )
+{
+   open_sale();
+   two_phases();
+   chain().time = sale_start + 1;
+   buy( name( "alice" ), eos( 1'0000 ) );
+   CHECK_EQUAL( mpt_of( name( "alice" ) ), mpt( 20'0000 ) );
+
+   // the shards are still split for the first phase, the buy settles them itself
+   chain().time = 1600;
+   buy( name( "bob" ), eos( 1'0000 ) );
+   CHECK_EQUAL( mpt_of( name( "bob" ) ), mpt( 10'0000 ) );
+}
+
+TEST_CASE( returns_pay_each_buyer_its_own_price )
+{
+   open_sale();
+   two_phases();
+   chain().time = sale_start + 1;
+   buy( name( "alice" ), eos( 1'0000 ) );
+   chain().time = 1600;
+   buy( name( "bob" ), eos( 1'0000 ) );
+
+   chain().time = buyback_start + 1;
+   send_mpt( name( "alice" ), sale, mpt( 10'0000 ) );
+   send_mpt( name( "bob" ), sale, mpt( 10'0000 ) );
+   CHECK_EQUAL( eos_of( name( "alice" ) ), eos( 5000 ) );
+   CHECK_EQUAL( eos_of( name( "bob" ) ), eos( 1'0000 ) );
+}
+
+TEST_CASE( moved_tokens_unlock_what_was_paid_for_them )
+{
+   open_sale();
+   two_phases();
+   accounts( { "carol" } );
+   chain().time = sale_start + 1;
+   buy( name( "alice" ), eos( 3'0000 ) );
+
+   send_mpt( name( "alice" ), name( "carol" ), mpt( 20'0000 ) );
+   chain().push( sale, name( "claimfunds" ), { token }, token );
+   CHECK_EQUAL( eos_of( token ), eos( 1'0000 ) );
+}
+
+TEST_CASE( a_rejecting_buyer_does_not_block_the_order_queue )
+{
+   open_sale();
+   chain().push( sale, name( "setqueue" ), { sale }, token, true );
+   name rejector( "rejector" );
+   name bob = shard_mate( rejector, "bob" );
+   chain().set_code( rejector, rejector_apply );
+   chain().time = sale_start + 1;
+   buy( rejector, eos( 1'0000 ) );
+   buy( bob, eos( 2'0000 ) );
+   CHECK_EQUAL( mpt_of( bob ), mpt( 0 ) );
+
+   chain().push( sale, name( "fillorders" ), { bob }, metpack::buyer_shard( bob ), uint32_t( 10 ) );
+   chain().push( sale, name( "claimorder" ), { bob }, bob );
+   CHECK_EQUAL( mpt_of( bob ), mpt( 20'0000 ) );
+   CHECK_ASSERT( chain().push( sale, name( "claimorder" ), { bob }, rejector ), "rejects MPT" );
+   CHECK_ASSERT( chain().push( sale, name( "claimorder" ), { bob }, bob ), "nothing to claim" );
+}
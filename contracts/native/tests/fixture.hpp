@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../tester.hpp"
+
+#include <eosiolib/asset.hpp>
+#include <eosiolib/symbol.hpp>
+
+#include <string>
+
+// Accounts and tokens most native tests start from: MPT created by
+// metpacktoken with itself as issuer, EOS issued by eosio, and the crowdsale
+// selling MPT for EOS at 10 MPT per EOS
+namespace fixture {
+
+   using eosio::asset;
+   using eosio::name;
+   using eosio::symbol;
+
+   inline const symbol mpt_symbol( "MPT", 4 );
+   inline const symbol eos_symbol( "EOS", 4 );
+
+   inline const name token( "metpacktoken" );
+   inline const name sale( "mptcrowdsale" );
+   inline const name team( "metpackteam" );
+   inline const name system_token( "eosio.token" );
+
+   inline asset mpt( int64_t amount ) { return asset( amount, mpt_symbol ); }
+   inline asset eos( int64_t amount ) { return asset( amount, eos_symbol ); }
+
+   // sale timeline, the crowdsale runs from 1000 to 2000 and buys back from 3000 to 4000
+   static constexpr uint32_t sale_start     = 1000;
+   static constexpr uint32_t sale_end       = 2000;
+   static constexpr uint32_t buyback_start  = 3000;
+   static constexpr uint32_t buyback_end    = 4000;
+
+   inline native::chain& chain() { return native::chain::get(); }
+
+   inline void accounts( std::initializer_list<const char*> names )
+   {
+      for( const char* n : names ) chain().create_account( name( n ) );
+   }
+
+   // MPT with metpacktoken as issuer, supply issued to metpacktoken
+   inline void create_mpt( int64_t supply = 1'000'000'000'0000 )
+   {
+      chain().push( token, name( "create" ), { token }, token, mpt( supply ) );
+      chain().push( token, name( "issue" ), { token }, token, mpt( supply ), std::string( "supply" ) );
+   }
+
+   inline void create_eos()
+   {
+      accounts( { "eosio" } );
+      chain().push( system_token, name( "create" ), { system_token }, name( "eosio" ), eos( 10'000'000'000'0000 ) );
+   }
+
+   inline void give_eos( name to, asset quantity )
+   {
+      chain().push( system_token, name( "issue" ), { name( "eosio" ) }, to, quantity, std::string() );
+   }
+
+   inline void send_mpt( name from, name to, asset quantity )
+   {
+      chain().push( token, name( "transfer" ), { from }, from, to, quantity, std::string() );
+   }
+
+   inline void send_eos( name from, name to, asset quantity )
+   {
+      chain().push( system_token, name( "transfer" ), { from }, from, to, quantity, std::string() );
+   }
+
+   inline asset mpt_of( name owner ) { return native::test::balance( token, owner, mpt_symbol ); }
+   inline asset eos_of( name owner ) { return native::test::balance( system_token, owner, eos_symbol ); }
+
+   // crowdsale holding tokens_for_sale MPT at 10 MPT per EOS, minimum buy 1 EOS
+   inline void open_sale( asset tokens_for_sale = mpt( 100'000'000'0000 ) )
+   {
+      create_mpt();
+      create_eos();
+      send_mpt( token, sale, tokens_for_sale );
+      chain().push( sale, name( "addtoken" ), { sale },
+                    token, token, tokens_for_sale, eos( 1'0000 ), eos( 0 ),
+                    uint64_t( 10 ), uint64_t( 1 ), sale_start, sale_end, buyback_start, buyback_end );
+   }
+
+   // buyer pays payment into the sale while it runs
+   inline void buy( name buyer, asset payment )
+   {
+      if( !chain().accounts.count( buyer.value ) ) chain().create_account( buyer );
+      if( eos_of( buyer ) < payment ) give_eos( buyer, payment - eos_of( buyer ) );
+      send_eos( buyer, sale, payment );
+   }
+
+   // currency_stats of MPT read as the leading fields the tests look at
+   struct mpt_stats {
+      asset supply;
+      asset max_supply;
+      name  issuer;
+   };
+
+   inline mpt_stats stats() { return *native::test::row<mpt_stats>( token, mpt_symbol.code().raw(), name( "stat" ), mpt_symbol.code().raw() ); }
+
+} /// namespace fixture
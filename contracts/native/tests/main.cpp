@@ -0,0 +1,6 @@
+#include "../tester.hpp"
+
+int main( int argc, char** argv )
+{
+   return native::test::run( argc, argv );
+}
@@ -0,0 +1,121 @@
+#include "../tester.hpp"
+
+#include "../../mptcrowdsale/pricing.hpp"
+
+#include <random>
+
+// pricing divides with a precomputed reciprocal, compared here against plain
+// 128 bit division on random and edge operands
+
+namespace {
+
+   using pricing::uint128;
+
+   // denominator of a random bit width, so small and full width ones both occur
+   uint64_t random_den( std::mt19937_64& rng )
+   {
+      uint64_t den = rng() >> ( rng() % 64 );
+      return den == 0 ? 1 : den;
+   }
+
+   int64_t reference( uint64_t amount, uint64_t num, uint64_t den, pricing::rounding mode )
+   {
+      uint128 n = uint128( amount ) * num;
+      uint128 q = n / den;
+      uint128 r = n % den;
+      if( mode == pricing::rounding::up && r != 0 ) ++q;
+      if( mode == pricing::rounding::nearest && 2 * r >= den ) ++q;
+      return q > uint128( eosio::asset::max_amount ) ? -1 : static_cast<int64_t>( q );
+   }
+
+   struct step {
+      uint32_t start;
+      int      id;
+   };
+
+}
+
+TEST_CASE( pricing_divide_matches_int128 )
+{
+   std::mt19937_64 rng( 7 );
+   for( int i = 0; i < 200'000; ++i )
+   {
+      uint64_t den = random_den( rng );
+      auto r = pricing::make_ratio( 1, den );
+      uint64_t hi = rng() % den;
+      uint128 n = ( uint128( hi ) << 64 ) | rng();
+      auto qr = pricing::divide( r, n );
+      CHECK( qr.quot == static_cast<uint64_t>( n / den ) );
+      CHECK( qr.rem == static_cast<uint64_t>( n % den ) );
+   }
+
+   // largest dividend for the extreme denominators
+   for( uint64_t den : { uint64_t( 1 ), uint64_t( 2 ), uint64_t( 3 ), ~uint64_t( 0 ), uint64_t( 1 ) << 63, ( uint64_t( 1 ) << 63 ) + 1 } )
+   {
+      auto r = pricing::make_ratio( 1, den );
+      uint128 n = ( uint128( den - 1 ) << 64 ) | ~uint64_t( 0 );
+      auto qr = pricing::divide( r, n );
+      CHECK( qr.quot == static_cast<uint64_t>( n / den ) );
+      CHECK( qr.rem == static_cast<uint64_t>( n % den ) );
+   }
+}
+
+TEST_CASE( pricing_convert_rounds_like_int128 )
+{
+   std::mt19937_64 rng( 11 );
+   const pricing::rounding modes[] = { pricing::rounding::down, pricing::rounding::up, pricing::rounding::nearest };
+   for( int i = 0; i < 100'000; ++i )
+   {
+      uint64_t num = rng() >> ( rng() % 64 );
+      uint64_t den = random_den( rng );
+      uint64_t amount = static_cast<uint64_t>( eosio::asset::max_amount ) >> ( rng() % 63 );
+      amount = amount == 0 ? 0 : rng() % ( amount + 1 );
+      auto r = pricing::make_ratio( num, den );
+      for( auto mode : modes )
+      {
+         int64_t expected = reference( amount, num, den, mode );
+         if( expected < 0 ) CHECK_ASSERT( pricing::convert( r, static_cast<int64_t>( amount ), mode ), "price conversion overflow" );
+         else CHECK_EQUAL( pricing::convert( r, static_cast<int64_t>( amount ), mode ), expected );
+      }
+   }
+}
+
+TEST_CASE( pricing_rounding_modes )
+{
+   auto third = pricing::make_ratio( 20, 6 );
+   CHECK_EQUAL( third.num, uint64_t( 10 ) );
+   CHECK_EQUAL( third.den, uint64_t( 3 ) );
+   CHECK_EQUAL( pricing::convert( third, 1, pricing::rounding::down ), int64_t( 3 ) );
+   CHECK_EQUAL( pricing::convert( third, 1, pricing::rounding::up ), int64_t( 4 ) );
+   CHECK_EQUAL( pricing::convert( third, 1, pricing::rounding::nearest ), int64_t( 3 ) );
+   CHECK_EQUAL( pricing::convert( third, 2, pricing::rounding::nearest ), int64_t( 7 ) );
+   CHECK_EQUAL( pricing::convert( third, 3, pricing::rounding::up ), int64_t( 10 ) );
+
+   // halves round up
+   auto half = pricing::make_ratio( 1, 2 );
+   CHECK_EQUAL( pricing::convert( half, 1, pricing::rounding::down ), int64_t( 0 ) );
+   CHECK_EQUAL( pricing::convert( half, 1, pricing::rounding::nearest ), int64_t( 1 ) );
+   CHECK_EQUAL( pricing::convert( half, 3, pricing::rounding::nearest ), int64_t( 2 ) );
+
+   CHECK_ASSERT( pricing::convert( third, -1, pricing::rounding::down ), "cannot convert a negative amount" );
+   CHECK_ASSERT( pricing::convert( pricing::make_ratio( 2, 1 ), eosio::asset::max_amount, pricing::rounding::down ),
+                 "price conversion overflow" );
+   CHECK_EQUAL( pricing::convert( pricing::make_ratio( 1, 1 ), eosio::asset::max_amount, pricing::rounding::up ),
+                eosio::asset::max_amount );
+}
+
+TEST_CASE( pricing_at_time_picks_the_active_step )
+{
+   const step curve[] = { { 100, 0 }, { 200, 1 }, { 300, 2 } };
+   auto at = [&]( uint32_t t ) { return pricing::at_time( std::begin( curve ), std::end( curve ), t )->id; };
+
+   CHECK_ASSERT( at( 99 ), "price curve has not started" );
+   CHECK_EQUAL( at( 100 ), 0 );
+   CHECK_EQUAL( at( 199 ), 0 );
+   CHECK_EQUAL( at( 200 ), 1 );
+   CHECK_EQUAL( at( 300 ), 2 );
+   CHECK_EQUAL( at( 1'000'000 ), 2 );
+
+   const step single[] = { { 50, 7 } };
+   CHECK_EQUAL( pricing::at_time( std::begin( single ), std::end( single ), 50 )->id, 7 );
+}
@@ -0,0 +1,179 @@
+#include "fixture.hpp"
+
+using namespace fixture;
+
+TEST_CASE( issue_and_transfer )
+{
+   accounts( { "alice", "bob" } );
+   create_mpt( 1'000'0000 );
+   send_mpt( token, name( "alice" ), mpt( 300'0000 ) );
+   send_mpt( name( "alice" ), name( "bob" ), mpt( 100'0000 ) );
+
+   CHECK_EQUAL( mpt_of( token ), mpt( 700'0000 ) );
+   CHECK_EQUAL( mpt_of( name( "alice" ) ), mpt( 200'0000 ) );
+   CHECK_EQUAL( mpt_of( name( "bob" ) ), mpt( 100'0000 ) );
+   CHECK_EQUAL( stats().supply, mpt( 1'000'0000 ) );
+}
+
+TEST_CASE( failed_transaction_rolls_back )
+{
+   accounts( { "alice", "bob" } );
+   create_mpt( 1'000'0000 );
+   send_mpt( token, name( "alice" ), mpt( 10'0000 ) );
+   auto before = chain().tables;
+
+   CHECK_ASSERT( send_mpt( name( "alice" ), name( "bob" ), mpt( 11'0000 ) ), "overdrawn balance" );
+   CHECK( chain().tables == before );
+   CHECK_ASSERT( chain().push( token, name( "transfer" ), { name( "bob" ) }, name( "alice" ), name( "bob" ), mpt( 1 ), std::string() ),
+                 "missing authority of alice" );
+}
+
+TEST_CASE( crowdsale_buy_and_return )
+{
+   open_sale();
+   chain().time = sale_start + 1;
+   buy( name( "alice" ), eos( 5'0000 ) );
+   CHECK_EQUAL( mpt_of( name( "alice" ) ), mpt( 50'0000 ) );
+   CHECK_EQUAL( eos_of( sale ), eos( 5'0000 ) );
+
+   // untouched crowdsale tokens go back for what was paid during the buyback
+   chain().time = buyback_start + 1;
+   send_mpt( name( "alice" ), sale, mpt( 20'0000 ) );
+   CHECK_EQUAL( mpt_of( name( "alice" ) ), mpt( 30'0000 ) );
+   CHECK_EQUAL( eos_of( name( "alice" ) ), eos( 2'0000 ) );
+}
+
+TEST_CASE( team_withdraw_after_lockup )
+{
+   create_mpt( 1'000'0000 );
+   accounts( { "carol" } );
+   send_mpt( token, team, mpt( 100'0000 ) );
+   chain().push( team, name( "addtoken" ), { team }, token, mpt_symbol, uint32_t( 100 ), uint32_t( 50 ) );
+   chain().push( team, name( "addmember" ), { team }, name( "carol" ), token, mpt( 40'0000 ) );
+
+   chain().time = 120;
+   CHECK_ASSERT( chain().push( team, name( "withdraw" ), { name( "carol" ) }, name( "carol" ), token, mpt_symbol ), "be patient" );
+   chain().time = 151;
+   chain().push( team, name( "withdraw" ), { name( "carol" ) }, name( "carol" ), token, mpt_symbol );
+   CHECK_EQUAL( mpt_of( name( "carol" ) ), mpt( 40'0000 ) );
+   CHECK_EQUAL( mpt_of( team ), mpt( 60'0000 ) );
+}
+
+TEST_CASE( queued_airdrops_reserve_supply_and_can_be_unqueued )
+{
+   accounts( { "alice", "bob" } );
+   chain().push( token, name( "create" ), { token }, token, mpt( 1'000'0000 ) );
+   chain().push( token, name( "issue" ), { token }, token, mpt( 900'0000 ), std::string() );
+
+   using drops = std::vector<std::pair<name, asset>>;
+   CHECK_ASSERT( chain().push( token, name( "queuedrop" ), { token }, drops{ { name( "alice" ), mpt( 60'0000 ) }, { name( "bob" ), mpt( 50'0000 ) } } ),
+                 "quantity exceeds available supply" );
+   chain().push( token, name( "queuedrop" ), { token }, drops{ { name( "alice" ), mpt( 60'0000 ) }, { name( "bob" ), mpt( 40'0000 ) } } );
+   CHECK_EQUAL( stats().supply, mpt( 1'000'0000 ) );
+
+   // the row of alice is taken out, bob is drained and the supply drops by what alice reserved
+   chain().push( token, name( "unqueue" ), { token }, mpt_symbol, std::vector<uint64_t>{ 0 } );
+   chain().push( token, name( "drain" ), { token }, mpt_symbol, uint32_t( 10 ) );
+   CHECK_EQUAL( mpt_of( name( "alice" ) ), mpt( 0 ) );
+   CHECK_EQUAL( mpt_of( name( "bob" ) ), mpt( 40'0000 ) );
+   CHECK_EQUAL( stats().supply, mpt( 940'0000 ) );
+}
+
+TEST_CASE( a_transfer_bills_the_sender_row_to_its_owner )
+{
+   accounts( { "alice", "bob", "carol" } );
+   create_mpt( 1'000'0000 );
+   send_mpt( token, name( "alice" ), mpt( 10'0000 ) );
+   send_mpt( name( "alice" ), name( "bob" ), mpt( 5'0000 ) );
+   CHECK_EQUAL( chain().row_payer( token, name( "bob" ).value, name( "accounts" ), mpt_symbol.code().raw() ), name( "alice" ).value );
+
+   send_mpt( name( "bob" ), name( "carol" ), mpt( 1'0000 ) );
+   CHECK_EQUAL( chain().row_payer( token, name( "bob" ).value, name( "accounts" ), mpt_symbol.code().raw() ), name( "bob" ).value );
+
+   // a spender moving bob's tokens does not take over bob's row
+   chain().push( token, name( "approve" ), { name( "bob" ) }, name( "bob" ), name( "carol" ), mpt( 2'0000 ) );
+   chain().push( token, name( "transferfrom" ), { name( "carol" ) }, name( "carol" ), name( "bob" ), name( "alice" ), mpt( 1'0000 ), std::string() );
+   CHECK_EQUAL( chain().row_payer( token, name( "bob" ).value, name( "accounts" ), mpt_symbol.code().raw() ), name( "bob" ).value );
+}
+
+TEST_CASE( the_crowdsale_only_takes_plain_transfers )
+{
+   open_sale();
+   accounts( { "bob" } );
+   chain().time = sale_start + 1;
+   buy( name( "alice" ), eos( 1'0000 ) );
+   using batch = std::vector<std::pair<name, asset>>;
+   CHECK_ASSERT( chain().push( token, name( "transferbatch" ), { name( "alice" ) }, name( "alice" ), batch{ { sale, mpt( 1'0000 ) } }, std::string() ),
+                 "transfer to the crowdsale with transfer" );
+   chain().push( token, name( "approve" ), { name( "alice" ) }, name( "alice" ), name( "bob" ), mpt( 1'0000 ) );
+   CHECK_ASSERT( chain().push( token, name( "transferfrom" ), { name( "bob" ) }, name( "bob" ), name( "alice" ), sale, mpt( 1'0000 ), std::string() ),
+                 "transfer to the crowdsale with transfer" );
+}
+
+namespace {
+
+   // currency_stats with the counters extension
+   struct holder_counters {
+      uint64_t holders;
+      asset    claimed;
+      asset    unclaimed;
+      asset    circulating;
+   };
+
+   struct counted_stats {
+      asset supply;
+      asset max_supply;
+      name  issuer;
+      eosio::binary_extension<bool>            holder_registry;
+      eosio::binary_extension<holder_counters> counters;
+   };
+
+   asset circulating()
+   {
+      return native::test::row<counted_stats>( token, mpt_symbol.code().raw(), name( "stat" ), mpt_symbol.code().raw() )->counters.value().circulating;
+   }
+
+}
+
+TEST_CASE( a_new_issuer_leaves_the_circulating_supply )
+{
+   accounts( { "alice", "bob" } );
+   create_mpt( 1'000'0000 );
+   send_mpt( token, name( "alice" ), mpt( 300'0000 ) );
+   send_mpt( token, name( "bob" ), mpt( 100'0000 ) );
+   CHECK_EQUAL( circulating(), mpt( 400'0000 ) );
+
+   chain().push( token, name( "update" ), { token }, name( "alice" ), mpt_symbol );
+   CHECK_EQUAL( circulating(), mpt( 100'0000 ) );
+   chain().push( token, name( "update" ), { token }, name( "bob" ), mpt_symbol );
+   CHECK_EQUAL( circulating(), mpt( 300'0000 ) );
+}
+
+TEST_CASE( moveteam_resumes_at_its_cursor )
+{
+   create_mpt( 1'000'0000 );
+   chain().push( team, name( "addtoken" ), { team }, token, mpt_symbol, uint32_t( 100 ), uint32_t( 50 ) );
+
+   // members written by the code from before the per token scopes
+   struct legacy_member {
+      name  accountname;
+      asset credit;
+   };
+   auto& legacy = chain().tables[native::table_id{ team.value, team.value, name( "team" ).value }];
+   for( const auto& m : { legacy_member{ name( "anna" ), mpt( 1'0000 ) },
+                          legacy_member{ name( "bert" ), asset( 1'0000, symbol( "XYZ", 4 ) ) },
+                          legacy_member{ name( "cleo" ), mpt( 2'0000 ) } } )
+   {
+      legacy[m.accountname.value] = native::stored_row{ eosio::pack( m ), team.value };
+   }
+
+   chain().push( team, name( "moveteam" ), { team }, token, name(), uint32_t( 1 ) );
+   CHECK_EQUAL( chain().traces().front().console, std::string( "{\"moved\":1,\"cursor\":\"bert\"}" ) );
+   chain().push( team, name( "moveteam" ), { team }, token, name( "bert" ), uint32_t( 1 ) );
+   CHECK_EQUAL( chain().traces().front().console, std::string( "{\"moved\":0,\"cursor\":\"cleo\"}" ) );
+   chain().push( team, name( "moveteam" ), { team }, token, name( "cleo" ), uint32_t( 5 ) );
+   CHECK_EQUAL( chain().traces().front().console, std::string( "{\"moved\":1,\"cursor\":\"\"}" ) );
+
+   CHECK( native::test::row<legacy_member>( team, token.value, name( "team" ), name( "cleo" ).value ).has_value() );
+   CHECK( native::test::row<legacy_member>( team, team.value, name( "team" ), name( "bert" ).value ).has_value() );
+}